@@ -15,6 +15,7 @@
  */
 
 #include <stddef.h>
+#include <string.h>
 #include "cat25256.h"
 
 #define WREN    0b00000110
@@ -25,7 +26,11 @@
 #define WRITE   0b00000010
 
 #define NREADY     0x01
-#define PAGE_SIZE  64
+#define BP0        0x04
+#define BP1        0x08
+#define WPEN       0x80
+#define NONVOLATILE_BITS (WPEN | BP1 | BP0)
+#define PAGE_SIZE  CAT25256_PAGE_SIZE
 
 static memory_status_t cat25256_check_handle(const cat25256_handle_t *const handle) {
     if (handle == NULL) {
@@ -46,6 +51,52 @@ static memory_status_t cat25256_check_handle(const cat25256_handle_t *const hand
     return MEMORY_STATUS_OK;
 }
 
+static inline uint32_t cat25256_capacity(const cat25256_handle_t *handle) {
+    return handle->capacity != 0 ? handle->capacity : CAT25256_CAPACITY;
+}
+
+static inline uint8_t cat25256_in_range(const cat25256_handle_t *handle, uint32_t address, uint32_t length) {
+    uint32_t capacity = cat25256_capacity(handle);
+    return address < capacity && length <= capacity - address;
+}
+
+#if CAT25256_FEATURE_HOLD
+
+static memory_status_t cat25256_read_data(cat25256_handle_t *handle, uint8_t *data, uint32_t length, size_t cs) {
+    uint32_t chunk = handle->hold_chunk_size;
+    if (chunk == 0 || handle->hold_assert == NULL || handle->hold_release == NULL ||
+        handle->urgent_transfer == NULL) {
+        return handle->read(handle->low_level_handle, data, length);
+    }
+
+    while (length > chunk) {
+        if (handle->read(handle->low_level_handle, data, chunk) != MEMORY_STATUS_OK) {
+            return MEMORY_STATUS_NOK;
+        }
+        data += chunk;
+        length -= chunk;
+
+        // The chip keeps its address counter while HOLD is asserted, CS stays low
+        if (handle->hold_assert(handle->low_level_handle, cs) != MEMORY_STATUS_OK) {
+            return MEMORY_STATUS_NOK;
+        }
+        handle->urgent_transfer(handle->low_level_handle);
+        if (handle->hold_release(handle->low_level_handle, cs) != MEMORY_STATUS_OK) {
+            return MEMORY_STATUS_NOK;
+        }
+    }
+    return handle->read(handle->low_level_handle, data, length);
+}
+
+#else
+
+static inline memory_status_t cat25256_read_data(cat25256_handle_t *handle, uint8_t *data, uint32_t length, size_t cs) {
+    (void) cs;
+    return handle->read(handle->low_level_handle, data, length);
+}
+
+#endif
+
 static memory_status_t
 cat25256_atomic_read(cat25256_handle_t *handle, uint32_t address, uint8_t *data, uint32_t length, size_t cs) {
     uint8_t header[3] = {0};
@@ -58,18 +109,117 @@ cat25256_atomic_read(cat25256_handle_t *handle, uint32_t address, uint8_t *data,
         handle->cs_disable(handle->low_level_handle, cs);
         return MEMORY_STATUS_NOK;
     }
-    uint8_t rc = handle->read(handle->low_level_handle, data, length);
+    uint8_t rc = cat25256_read_data(handle, data, length, cs);
     handle->cs_disable(handle->low_level_handle, cs);
 
     return rc;
 }
 
+#if CAT25256_FEATURE_READAHEAD
+
+static void cat25256_readahead_adapt(cat25256_readahead_t *ra) {
+    if (!ra->valid) {
+        return;
+    }
+    // Grow while prefetches are used up, shrink when most of one was wasted
+    if (ra->consumed >= ra->length) {
+        ra->window = ra->window * 2 <= ra->size ? ra->window * 2 : ra->size;
+    } else if (ra->consumed < ra->length / 2) {
+        ra->window = ra->window / 2 >= CAT25256_READAHEAD_MIN_WINDOW ? ra->window / 2 : CAT25256_READAHEAD_MIN_WINDOW;
+    }
+    ra->valid = 0;
+}
+
+static memory_status_t
+cat25256_readahead_read(cat25256_handle_t *handle, uint32_t address, uint8_t *data, uint32_t length, size_t cs) {
+    cat25256_readahead_t *ra = handle->readahead;
+    if (ra->window < CAT25256_READAHEAD_MIN_WINDOW || ra->window > ra->size) {
+        ra->window = ra->size < CAT25256_READAHEAD_MIN_WINDOW ? ra->size : CAT25256_READAHEAD_MIN_WINDOW;
+    }
+
+    if (ra->valid && ra->cs == cs && address >= ra->start && address - ra->start + length <= ra->length) {
+        memcpy(data, &ra->buffer[address - ra->start], length);
+        ra->consumed = ra->consumed + length < ra->length ? (uint16_t) (ra->consumed + length) : ra->length;
+        ra->next = address + length;
+        ra->hits++;
+        return MEMORY_STATUS_OK;
+    }
+
+    ra->misses++;
+    uint32_t served = 0;
+    if (ra->valid && ra->cs == cs && address >= ra->start && address - ra->start < ra->length) {
+        // The stream ran off the end of the prefetch, serve what it holds
+        served = ra->start + ra->length - address;
+        memcpy(data, &ra->buffer[address - ra->start], served);
+        ra->consumed = ra->length;
+    }
+
+    uint8_t sequential = served > 0 || (ra->cs == cs && address == ra->next);
+    ra->cs = cs;
+    ra->next = address + length;
+    address += served;
+    data += served;
+    length -= served;
+    if (!sequential || length >= ra->size) {
+        // Random access or too long to stage, the buffer stays valid
+        return cat25256_atomic_read(handle, address, data, length, cs);
+    }
+
+    cat25256_readahead_adapt(ra);
+    uint32_t fetch = length > ra->window ? length : ra->window;
+    uint32_t capacity = cat25256_capacity(handle);
+    if (fetch > capacity - address) {
+        fetch = capacity - address;
+    }
+
+    memory_status_t rc = cat25256_atomic_read(handle, address, ra->buffer, fetch, cs);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+    memcpy(data, ra->buffer, length);
+    ra->start = address;
+    ra->length = (uint16_t) fetch;
+    ra->consumed = (uint16_t) length;
+    ra->valid = 1;
+    return MEMORY_STATUS_OK;
+}
+
+static void cat25256_readahead_invalidate(cat25256_handle_t *handle, uint32_t address, uint32_t length, size_t cs) {
+    cat25256_readahead_t *ra = handle->readahead;
+    if (ra != NULL && ra->valid && ra->cs == cs && address < ra->start + ra->length && ra->start < address + length) {
+        ra->valid = 0;
+    }
+}
+
+#endif
+
 memory_status_t cat25256_read(cat25256_handle_t *handle, uint32_t address, uint8_t *data, uint32_t length, size_t cs) {
     memory_status_t rc = cat25256_check_handle(handle);
     if (rc != MEMORY_STATUS_OK) {
         return rc;
     }
 
+    if (!cat25256_in_range(handle, address, length)) {
+        uint32_t capacity = cat25256_capacity(handle);
+        if (handle->wrap != CAT25256_WRAP_AROUND || length > capacity) {
+            return MEMORY_STATUS_OUT_OF_RANGE;
+        }
+
+        // Split at the end of the device and continue at its start
+        address %= capacity;
+        uint32_t first = capacity - address < length ? capacity - address : length;
+        rc = cat25256_atomic_read(handle, address, data, first, cs);
+        if (rc != MEMORY_STATUS_OK || first == length) {
+            return rc;
+        }
+        return cat25256_atomic_read(handle, 0, &data[first], length - first, cs);
+    }
+
+#if CAT25256_FEATURE_READAHEAD
+    if (handle->readahead != NULL && handle->readahead->buffer != NULL && handle->readahead->size > 0) {
+        return cat25256_readahead_read(handle, address, data, length, cs);
+    }
+#endif
     return cat25256_atomic_read(handle, address, data, length, cs);
 }
 
@@ -92,7 +242,7 @@ memory_status_t cat25256_atomic_write_latch_disable(cat25256_handle_t *handle, s
     return cat25256_atomic_write_latch(handle, disable, cs);
 }
 
-memory_status_t cat25256_atomic_wait_wip_completed(cat25256_handle_t *handle, size_t cs) {
+static memory_status_t cat25256_atomic_poll_wip_completed(cat25256_handle_t *handle, size_t cs) {
     uint8_t wip = NREADY;
     while (wip & NREADY) {
         if (cat25256_read_register(handle, &wip, cs) != MEMORY_STATUS_OK) {
@@ -102,6 +252,79 @@ memory_status_t cat25256_atomic_wait_wip_completed(cat25256_handle_t *handle, si
     return MEMORY_STATUS_OK;
 }
 
+#if CAT25256_FEATURE_ADAPTIVE_WAIT
+
+static void cat25256_learn_write_cycle(cat25256_chip_state_t *chip, uint32_t sample) {
+    if (chip->write_cycle_us == 0) {
+        chip->write_cycle_us = sample;
+        return;
+    }
+    // Exponentially weighted moving average with a weight of 1/8 per sample
+    int32_t delta = (int32_t) sample - (int32_t) chip->write_cycle_us;
+    chip->write_cycle_us = (uint32_t) ((int32_t) chip->write_cycle_us + delta / 8);
+}
+
+memory_status_t cat25256_atomic_wait_wip_completed(cat25256_handle_t *handle, size_t cs) {
+    if (handle->get_time_us == NULL || handle->delay_us == NULL || cs >= CAT25256_MAX_CS) {
+        return cat25256_atomic_poll_wip_completed(handle, cs);
+    }
+
+    cat25256_chip_state_t *chip = &handle->chip[cs];
+    uint32_t start = handle->get_time_us(handle->low_level_handle);
+    uint8_t slept = 0;
+
+    // Sleep until just before the predicted completion, then poll finely
+    if (chip->write_cycle_us > CAT25256_WAIT_GUARD_US) {
+        handle->delay_us(handle->low_level_handle, chip->write_cycle_us - CAT25256_WAIT_GUARD_US);
+        slept = 1;
+    }
+
+    uint32_t polls = 0;
+    uint8_t wip = NREADY;
+    while (1) {
+        if (cat25256_read_register(handle, &wip, cs) != MEMORY_STATUS_OK) {
+            return MEMORY_STATUS_NOK;
+        }
+        polls++;
+        if (!(wip & NREADY)) {
+            break;
+        }
+#if CAT25256_POLL_INTERVAL_US > 0
+        handle->delay_us(handle->low_level_handle, CAT25256_POLL_INTERVAL_US);
+#endif
+    }
+
+    uint32_t elapsed = handle->get_time_us(handle->low_level_handle) - start;
+    if (slept && polls == 1) {
+        // Completed somewhere during the sleep, pull the estimate down
+        elapsed = elapsed > CAT25256_WAIT_GUARD_US ? elapsed - CAT25256_WAIT_GUARD_US : elapsed;
+    }
+    cat25256_learn_write_cycle(chip, elapsed);
+
+    return MEMORY_STATUS_OK;
+}
+
+#else
+
+memory_status_t cat25256_atomic_wait_wip_completed(cat25256_handle_t *handle, size_t cs) {
+    return cat25256_atomic_poll_wip_completed(handle, cs);
+}
+
+#endif
+
+memory_status_t cat25256_get_write_cycle_estimate(cat25256_handle_t *handle, uint32_t *write_cycle_us, size_t cs) {
+    memory_status_t rc = cat25256_check_handle(handle);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+    if (write_cycle_us == NULL || cs >= CAT25256_MAX_CS) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    *write_cycle_us = handle->chip[cs].write_cycle_us;
+    return MEMORY_STATUS_OK;
+}
+
 static memory_status_t
 cat25256_atomic_write(cat25256_handle_t *handle, uint32_t address, const uint8_t *data, uint32_t length, size_t cs) {
     uint8_t header[3] = {0};
@@ -124,17 +347,95 @@ cat25256_atomic_write(cat25256_handle_t *handle, uint32_t address, const uint8_t
     return rc;
 }
 
+static memory_status_t cat25256_status_shadow(cat25256_handle_t *handle, uint8_t *status, size_t cs) {
+    cat25256_chip_state_t *chip = &handle->chip[cs];
+    if (!chip->status_valid) {
+        uint8_t value;
+        if (cat25256_read_register(handle, &value, cs) != MEMORY_STATUS_OK) {
+            return MEMORY_STATUS_NOK;
+        }
+    }
+    *status = chip->status;
+    return MEMORY_STATUS_OK;
+}
+
+#if CAT25256_FEATURE_PROTECTION_CHECK
+
+static uint32_t cat25256_protected_start(uint8_t status, uint32_t capacity) {
+    switch ((status & (BP1 | BP0)) >> 2) {
+        case CAT25256_PROTECT_UPPER_QUARTER:
+            return capacity - capacity / 4;
+        case CAT25256_PROTECT_UPPER_HALF:
+            return capacity / 2;
+        case CAT25256_PROTECT_ALL:
+            return 0;
+        default:
+            return capacity;
+    }
+}
+
+static memory_status_t
+cat25256_check_protection(cat25256_handle_t *handle, uint32_t address, uint32_t length, size_t cs) {
+    // Only chips with a status register shadow are checked
+    if (cs >= CAT25256_MAX_CS) {
+        return MEMORY_STATUS_OK;
+    }
+
+    uint8_t status;
+    if (cat25256_status_shadow(handle, &status, cs) != MEMORY_STATUS_OK) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    // The range is within the capacity at this point
+    uint32_t start = cat25256_protected_start(status, cat25256_capacity(handle));
+    uint32_t last = address + (length > 0 ? length - 1 : 0);
+    if (last >= start) {
+        return MEMORY_STATUS_PROTECTED;
+    }
+    return MEMORY_STATUS_OK;
+}
+
+#else
+
+static inline memory_status_t
+cat25256_check_protection(cat25256_handle_t *handle, uint32_t address, uint32_t length, size_t cs) {
+    // The chip drops writes into protected ranges on its own
+    (void) handle;
+    (void) address;
+    (void) length;
+    (void) cs;
+    return MEMORY_STATUS_OK;
+}
+
+#endif
+
 memory_status_t
-cat25256_write_page(cat25256_handle_t *handle, uint32_t address, const uint8_t *data, uint32_t length, size_t cs) {
+cat25256_write_page_start(cat25256_handle_t *handle, uint32_t address, const uint8_t *data, uint32_t length,
+                          size_t cs) {
     memory_status_t rc = cat25256_check_handle(handle);
     if (rc != MEMORY_STATUS_OK) {
         return rc;
     }
 
-    if (cat25256_write_register(handle, NREADY, cs) != MEMORY_STATUS_OK) {
-        return MEMORY_STATUS_NOK;
+    if (!cat25256_in_range(handle, address, length)) {
+        // A page never crosses the end of the device, wrapping only moves it
+        if (handle->wrap != CAT25256_WRAP_AROUND) {
+            return MEMORY_STATUS_OUT_OF_RANGE;
+        }
+        address %= cat25256_capacity(handle);
+        if (!cat25256_in_range(handle, address, length)) {
+            return MEMORY_STATUS_OUT_OF_RANGE;
+        }
+    }
+
+    rc = cat25256_check_protection(handle, address, length, cs);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
     }
 
+#if CAT25256_FEATURE_READAHEAD
+    cat25256_readahead_invalidate(handle, address, length, cs);
+#endif
     if (cat25256_atomic_write_latch_enable(handle, cs) != MEMORY_STATUS_OK) {
         return MEMORY_STATUS_NOK;
     }
@@ -146,6 +447,27 @@ cat25256_write_page(cat25256_handle_t *handle, uint32_t address, const uint8_t *
 
     cat25256_atomic_write_latch_disable(handle, cs);
 
+    if (cs < CAT25256_MAX_CS) {
+        cat25256_chip_state_t *chip = &handle->chip[cs];
+        chip->programs++;
+#if CAT25256_FEATURE_WEAR_ACCOUNTING
+        uint32_t page = address / PAGE_SIZE;
+        if (chip->page_programs != NULL && page >= chip->first_page && page - chip->first_page < chip->page_count) {
+            chip->page_programs[page - chip->first_page]++;
+        }
+#endif
+    }
+
+    return rc;
+}
+
+memory_status_t
+cat25256_write_page(cat25256_handle_t *handle, uint32_t address, const uint8_t *data, uint32_t length, size_t cs) {
+    memory_status_t rc = cat25256_write_page_start(handle, address, data, length, cs);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
     if (cat25256_atomic_wait_wip_completed(handle, cs) != MEMORY_STATUS_OK) {
         return MEMORY_STATUS_NOK;
     }
@@ -169,6 +491,11 @@ memory_status_t cat25256_read_register(cat25256_handle_t *handle, uint8_t *data,
     rc = handle->read(handle->low_level_handle, data, 1);
     handle->cs_disable(handle->low_level_handle, cs);
 
+    if (rc == MEMORY_STATUS_OK && cs < CAT25256_MAX_CS) {
+        handle->chip[cs].status = *data & NONVOLATILE_BITS;
+        handle->chip[cs].status_valid = 1;
+    }
+
     return rc;
 }
 
@@ -184,6 +511,11 @@ memory_status_t cat25256_write_register(cat25256_handle_t *handle, uint8_t data,
     rc = handle->write(handle->low_level_handle, write_reg, sizeof write_reg);
     handle->cs_disable(handle->low_level_handle, cs);
 
+    // Whether the chip accepted it depends on WEL and WP, let the next use re-read the register
+    if (cs < CAT25256_MAX_CS) {
+        handle->chip[cs].status_valid = 0;
+    }
+
     return rc;
 }
 
@@ -198,7 +530,7 @@ cat25256_write_address_aligned(cat25256_handle_t *handle, uint32_t address, cons
     }
 
     for (int i = 0; i < page_count; ++i) {
-        if (i == page_count - 1) {
+        if (i == page_count - 1 && length % PAGE_SIZE != 0) {
             rc = cat25256_write_page(handle, address + i * PAGE_SIZE, &data[i * PAGE_SIZE], length % PAGE_SIZE, cs);
             if (rc != MEMORY_STATUS_OK) {
                 return rc;
@@ -232,8 +564,8 @@ cat25256_write_address_unaligned(cat25256_handle_t *handle, uint32_t address, co
     return rc;
 }
 
-memory_status_t
-cat25256_write(cat25256_handle_t *handle, uint32_t address, const uint8_t *data, uint32_t length, size_t cs) {
+static memory_status_t
+cat25256_write_range(cat25256_handle_t *handle, uint32_t address, const uint8_t *data, uint32_t length, size_t cs) {
     uint32_t fits = address % PAGE_SIZE + length;
     if (fits <= PAGE_SIZE) {
         return cat25256_write_page(handle, address, data, length, cs);
@@ -242,3 +574,104 @@ cat25256_write(cat25256_handle_t *handle, uint32_t address, const uint8_t *data,
     }
 }
 
+memory_status_t
+cat25256_write(cat25256_handle_t *handle, uint32_t address, const uint8_t *data, uint32_t length, size_t cs) {
+    memory_status_t rc = cat25256_check_handle(handle);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
+    uint32_t first = length;
+    if (!cat25256_in_range(handle, address, length)) {
+        uint32_t capacity = cat25256_capacity(handle);
+        if (handle->wrap != CAT25256_WRAP_AROUND || length > capacity) {
+            return MEMORY_STATUS_OUT_OF_RANGE;
+        }
+        address %= capacity;
+        first = capacity - address < length ? capacity - address : length;
+    }
+
+    // Reject the whole range up front instead of failing halfway through
+    rc = cat25256_check_protection(handle, address, first, cs);
+    if (rc == MEMORY_STATUS_OK && first < length) {
+        rc = cat25256_check_protection(handle, 0, length - first, cs);
+    }
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
+    rc = cat25256_write_range(handle, address, data, first, cs);
+    if (rc != MEMORY_STATUS_OK || first == length) {
+        return rc;
+    }
+    return cat25256_write_range(handle, 0, &data[first], length - first, cs);
+}
+
+memory_status_t cat25256_set_protection(cat25256_handle_t *handle, cat25256_protection_t protection, size_t cs) {
+    memory_status_t rc = cat25256_check_handle(handle);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+    if (protection > CAT25256_PROTECT_ALL) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    // Chips without a shadow are read directly, WPEN has to survive the write
+    uint8_t status;
+    if (cs < CAT25256_MAX_CS) {
+        rc = cat25256_status_shadow(handle, &status, cs);
+    } else {
+        rc = cat25256_read_register(handle, &status, cs);
+    }
+    if (rc != MEMORY_STATUS_OK) {
+        return MEMORY_STATUS_NOK;
+    }
+    status = (status & WPEN) | (uint8_t) (protection << 2);
+
+    if (cat25256_atomic_write_latch_enable(handle, cs) != MEMORY_STATUS_OK) {
+        return MEMORY_STATUS_NOK;
+    }
+    if (cat25256_write_register(handle, status, cs) != MEMORY_STATUS_OK) {
+        cat25256_atomic_write_latch_disable(handle, cs);
+        return MEMORY_STATUS_NOK;
+    }
+
+    // The status register is non-volatile, wait for its write cycle, the final poll refreshes the shadow
+    if (cat25256_atomic_poll_wip_completed(handle, cs) != MEMORY_STATUS_OK) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    if (cs < CAT25256_MAX_CS && (handle->chip[cs].status & (BP1 | BP0)) != (status & (BP1 | BP0))) {
+        // Rejected by the chip, e.g. because WPEN is set and WP is low
+        return MEMORY_STATUS_NOK;
+    }
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t cat25256_get_protection(cat25256_handle_t *handle, cat25256_protection_t *protection, size_t cs) {
+    memory_status_t rc = cat25256_check_handle(handle);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+    if (protection == NULL) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    uint8_t status;
+    if (cs < CAT25256_MAX_CS) {
+        rc = cat25256_status_shadow(handle, &status, cs);
+    } else {
+        rc = cat25256_read_register(handle, &status, cs);
+    }
+    if (rc != MEMORY_STATUS_OK) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    *protection = (cat25256_protection_t) ((status & (BP1 | BP0)) >> 2);
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t cat25256_refresh_status(cat25256_handle_t *handle, size_t cs) {
+    uint8_t status;
+    return cat25256_read_register(handle, &status, cs);
+}
@@ -19,20 +19,129 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "cat25256_profile.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 #define MAX_BURST_SIZE 62
 
+#define CAT25256_PAGE_SIZE 64
+#define CAT25256_CAPACITY  32768
+
+/**
+ * Guaranteed program/erase cycles per page
+ */
+#ifndef CAT25256_ENDURANCE_CYCLES
+#define CAT25256_ENDURANCE_CYCLES 1000000
+#endif
+
+/**
+ * Number of chip selects per handle for which the driver keeps per-chip state
+ */
+#ifndef CAT25256_MAX_CS
+#define CAT25256_MAX_CS 4
+#endif
+
+/**
+ * Adaptive write-cycle wait tuning, all values in microseconds
+ * The poll interval applies after the sleep, 0 polls back-to-back so completion is seen as early as with
+ * plain busy polling. Keep it well below the spread of tWC when raising it.
+ */
+#ifndef CAT25256_WAIT_GUARD_US
+#define CAT25256_WAIT_GUARD_US 200
+#endif
+
+#ifndef CAT25256_POLL_INTERVAL_US
+#define CAT25256_POLL_INTERVAL_US 0
+#endif
+
+/**
+ * Defaults used when the handle does not configure its timing
+ */
+#ifndef CAT25256_DEFAULT_SPI_CLOCK_HZ
+#define CAT25256_DEFAULT_SPI_CLOCK_HZ 1000000
+#endif
+
+#ifndef CAT25256_DEFAULT_WRITE_CYCLE_US
+#define CAT25256_DEFAULT_WRITE_CYCLE_US 5000
+#endif
+
 /**
  * Return values
  */
 typedef enum {
     MEMORY_STATUS_OK = 0,
     MEMORY_STATUS_NOK,
-    MEMORY_STATUS_INVALID_HANDLE
+    MEMORY_STATUS_INVALID_HANDLE,
+    MEMORY_STATUS_PROTECTED,
+    MEMORY_STATUS_OUT_OF_RANGE
 } memory_status_t;
 
+/**
+ * What happens to accesses beyond the capacity of the device
+ */
+typedef enum {
+    CAT25256_WRAP_REJECT = 0,
+    CAT25256_WRAP_AROUND
+} cat25256_wrap_t;
+
+/**
+ * Block protection levels set by the BP1/BP0 bits of the status register
+ */
+typedef enum {
+    CAT25256_PROTECT_NONE = 0,
+    CAT25256_PROTECT_UPPER_QUARTER,
+    CAT25256_PROTECT_UPPER_HALF,
+    CAT25256_PROTECT_ALL
+} cat25256_protection_t;
+
+/**
+ * Per-chip state maintained by the driver
+ * page_programs is optional, when set the driver counts the programs of pages
+ * [first_page, first_page + page_count) in it, see cat25256_wear.h.
+ */
+typedef struct {
+    uint32_t write_cycle_us;
+    uint32_t programs;
+    uint32_t *page_programs;
+    uint16_t first_page;
+    uint16_t page_count;
+    uint8_t status;
+    uint8_t status_valid;
+} cat25256_chip_state_t;
+
+/**
+ * Initial and smallest readahead window in bytes, limited to the size of the readahead buffer
+ */
+#ifndef CAT25256_READAHEAD_MIN_WINDOW
+#define CAT25256_READAHEAD_MIN_WINDOW 16
+#endif
+
+/**
+ * Sequential readahead state, buffer and size are provided by the application
+ * The window starts at CAT25256_READAHEAD_MIN_WINDOW and doubles up to size while prefetched data gets used,
+ * it halves when most of a prefetch is thrown away.
+ */
+typedef struct {
+    uint8_t *buffer;
+    uint16_t size;
+
+    uint16_t window;
+    uint16_t length;
+    uint16_t consumed;
+    uint8_t valid;
+    size_t cs;
+    uint32_t start;
+    uint32_t next;
+    uint32_t hits;
+    uint32_t misses;
+} cat25256_readahead_t;
+
 /**
  * Provides abstraction for SPI communication with CAT25256 memory
+ * Zero-initialize it before setting the callbacks, optional callbacks may be left NULL.
  */
 typedef struct {
     void *low_level_handle;
@@ -44,6 +153,55 @@ typedef struct {
     memory_status_t (*cs_enable)(void *handle, size_t cs);
 
     memory_status_t (*cs_disable)(void *handle, size_t cs);
+
+    /**
+     * Optional: monotonic microsecond time base and delay, enable the adaptive write-cycle wait
+     */
+    uint32_t (*get_time_us)(void *handle);
+
+    void (*delay_us)(void *handle, uint32_t us);
+
+    /**
+     * Optional: bus clock and worst case tWC, 0 selects the defaults
+     */
+    uint32_t spi_clock_hz;
+
+    uint32_t write_cycle_us;
+
+    /**
+     * Optional: serialize read-modify-write sequences per chip, e.g. with an RTOS mutex
+     */
+    memory_status_t (*lock)(void *handle, size_t cs);
+
+    memory_status_t (*unlock)(void *handle, size_t cs);
+
+    /**
+     * Optional: capacity in bytes (a multiple of the page size, 0 selects CAT25256_CAPACITY) and what
+     * happens to accesses beyond it. By default they are rejected with MEMORY_STATUS_OUT_OF_RANGE.
+     */
+    uint32_t capacity;
+
+    cat25256_wrap_t wrap;
+
+    /**
+     * Optional: readahead for sequential reads, requires CAT25256_FEATURE_READAHEAD
+     */
+    cat25256_readahead_t *readahead;
+
+    /**
+     * Optional: drive the HOLD input, requires CAT25256_FEATURE_HOLD. With all three callbacks and a
+     * hold_chunk_size, reads longer than a chunk pause on HOLD after every chunk and hand the bus to
+     * urgent_transfer, then continue without reissuing command and address.
+     */
+    memory_status_t (*hold_assert)(void *handle, size_t cs);
+
+    memory_status_t (*hold_release)(void *handle, size_t cs);
+
+    void (*urgent_transfer)(void *handle);
+
+    uint32_t hold_chunk_size;
+
+    cat25256_chip_state_t chip[CAT25256_MAX_CS];
 } cat25256_handle_t;
 
 
@@ -54,7 +212,8 @@ typedef struct {
  * @param data The data buffer to read into
  * @param length The length of the data buffer
  * @param cs The chip select to use
- * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure, MEMORY_STATUS_OUT_OF_RANGE if the range
+ * exceeds the capacity and the handle does not wrap
  */
 memory_status_t cat25256_read(cat25256_handle_t *handle, uint32_t address, uint8_t *data, uint32_t length, size_t cs);
 
@@ -65,11 +224,27 @@ memory_status_t cat25256_read(cat25256_handle_t *handle, uint32_t address, uint8
  * @param data The data buffer to write
  * @param length The length of the data buffer
  * @param cs The chip select to use
- * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure, MEMORY_STATUS_PROTECTED if the page is
+ * block-protected, MEMORY_STATUS_OUT_OF_RANGE if the range exceeds the capacity and the handle does not wrap
  */
 memory_status_t
 cat25256_write_page(cat25256_handle_t *handle, uint32_t address, const uint8_t *data, uint32_t length, size_t cs);
 
+/**
+ * @brief Starts programming a single EEPROM-page and returns without waiting for the write cycle.
+ * The chip ignores every command but RDSR until the NREADY bit (0x01) of cat25256_read_register clears.
+ * @param handle The cat25256_handle_t to use
+ * @param address The address to write to
+ * @param data The data buffer to write
+ * @param length The length of the data buffer
+ * @param cs The chip select to use
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure, MEMORY_STATUS_PROTECTED if the page is
+ * block-protected, MEMORY_STATUS_OUT_OF_RANGE if the range exceeds the capacity and the handle does not wrap
+ */
+memory_status_t
+cat25256_write_page_start(cat25256_handle_t *handle, uint32_t address, const uint8_t *data, uint32_t length,
+                          size_t cs);
+
 /**
  * @brief Writes as much data to any address you want
  * @param handle The cat25256_handle_t to use
@@ -77,7 +252,9 @@ cat25256_write_page(cat25256_handle_t *handle, uint32_t address, const uint8_t *
  * @param data The data buffer to write
  * @param length The length of the data buffer
  * @param cs The chip select to use
- * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure, MEMORY_STATUS_PROTECTED if any part of
+ * the range is block-protected, in which case nothing is written, MEMORY_STATUS_OUT_OF_RANGE if the range
+ * exceeds the capacity and the handle does not wrap
  */
 memory_status_t
 cat25256_write(cat25256_handle_t *handle, uint32_t address, const uint8_t *data, uint32_t length, size_t cs);
@@ -100,4 +277,45 @@ memory_status_t cat25256_read_register(cat25256_handle_t *handle, uint8_t *data,
  */
 memory_status_t cat25256_write_register(cat25256_handle_t *handle, uint8_t data, size_t cs);
 
+/**
+ * @brief Returns the learned internal write-cycle time (tWC) of a chip.
+ * @param handle The handle to use
+ * @param write_cycle_us The estimate in microseconds, 0 if nothing has been learned yet
+ * @param cs The chip select to use
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK if the chip select has no state
+ */
+memory_status_t cat25256_get_write_cycle_estimate(cat25256_handle_t *handle, uint32_t *write_cycle_us, size_t cs);
+
+/**
+ * @brief Sets the block protection of the CAT25256 memory and updates the status register shadow.
+ * WPEN is kept, chips without a shadow have their status register read first.
+ * @param handle The handle to use
+ * @param protection The range to protect
+ * @param cs The chip select to use
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_set_protection(cat25256_handle_t *handle, cat25256_protection_t protection, size_t cs);
+
+/**
+ * @brief Returns the block protection from the status register shadow, reading the register only if the
+ * shadow is not valid yet.
+ * @param handle The handle to use
+ * @param protection The protected range
+ * @param cs The chip select to use
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_get_protection(cat25256_handle_t *handle, cat25256_protection_t *protection, size_t cs);
+
+/**
+ * @brief Re-reads the status register into its shadow, e.g. after the WP pin or another master changed it.
+ * @param handle The handle to use
+ * @param cs The chip select to use
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_refresh_status(cat25256_handle_t *handle, size_t cs);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif //_CAT25256_H
@@ -0,0 +1,138 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "cat25256_arena.h"
+#include "cat25256_delta.h"
+
+#define PAGE_SIZE CAT25256_PAGE_SIZE
+
+static size_t cat25256_arena_round(size_t size) {
+    return (size + CAT25256_ARENA_ALIGN - 1) / CAT25256_ARENA_ALIGN * CAT25256_ARENA_ALIGN;
+}
+
+memory_status_t cat25256_arena_init(cat25256_arena_t *arena, void *memory, size_t size) {
+    if (arena == NULL || (memory == NULL && size > 0)) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    // Align the start, the sizes reported by cat25256_arena_size_query assume an aligned base
+    uintptr_t start = (uintptr_t) memory;
+    size_t padding = (CAT25256_ARENA_ALIGN - start % CAT25256_ARENA_ALIGN) % CAT25256_ARENA_ALIGN;
+    if (padding > size) {
+        padding = size;
+    }
+
+    arena->base = (uint8_t *) memory + padding;
+    arena->size = size - padding;
+    arena->used = 0;
+    return MEMORY_STATUS_OK;
+}
+
+void *cat25256_arena_alloc(cat25256_arena_t *arena, size_t size) {
+    if (arena == NULL || size == 0) {
+        return NULL;
+    }
+
+    size_t rounded = cat25256_arena_round(size);
+    if (rounded > arena->size - arena->used) {
+        return NULL;
+    }
+
+    void *block = &arena->base[arena->used];
+    arena->used += rounded;
+    memset(block, 0, rounded);
+    return block;
+}
+
+size_t cat25256_arena_size_query(const cat25256_arena_config_t *config, cat25256_arena_sizes_t *sizes) {
+    cat25256_arena_sizes_t needed = {0};
+    if (config == NULL) {
+        if (sizes != NULL) {
+            *sizes = needed;
+        }
+        return 0;
+    }
+
+    if (config->wear_pages > 0) {
+        needed.wear = cat25256_arena_round(config->wear_pages * sizeof(uint32_t));
+    }
+    if (config->cache_slots > 0) {
+        needed.cache = cat25256_arena_round(config->cache_slots * sizeof(cat25256_cache_slot_t));
+    }
+    if (config->pack_pages > 0) {
+        needed.pack = cat25256_arena_round(config->pack_records * sizeof(uint16_t)) +
+                      cat25256_arena_round((size_t) config->pack_pages * PAGE_SIZE) +
+                      cat25256_arena_round((config->pack_pages + 7) / 8);
+    }
+    if (config->delta_size > 0) {
+        needed.delta = cat25256_arena_round(CAT25256_DELTA_REGION_SIZE((size_t) config->delta_size,
+                                                                       (size_t) config->delta_log_size));
+    }
+    if (config->schema_image_size > 0) {
+        needed.schema = cat25256_arena_round(config->schema_image_size);
+    }
+    if (config->limit_staging_size > 0) {
+        needed.limit = cat25256_arena_round(config->limit_staging_size);
+    }
+    if (config->readahead_size > 0) {
+        needed.readahead = cat25256_arena_round(config->readahead_size);
+    }
+    needed.total = needed.wear + needed.cache + needed.pack + needed.delta + needed.schema + needed.limit +
+                   needed.readahead;
+
+    if (sizes != NULL) {
+        *sizes = needed;
+    }
+    return needed.total;
+}
+
+memory_status_t
+cat25256_arena_carve(cat25256_arena_t *arena, const cat25256_arena_config_t *config, cat25256_arena_layout_t *layout) {
+    if (arena == NULL || config == NULL || layout == NULL) {
+        return MEMORY_STATUS_NOK;
+    }
+    if (cat25256_arena_size_query(config, NULL) > arena->size - arena->used) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    memset(layout, 0, sizeof *layout);
+    if (config->wear_pages > 0) {
+        layout->wear_counters = cat25256_arena_alloc(arena, config->wear_pages * sizeof(uint32_t));
+    }
+    if (config->cache_slots > 0) {
+        layout->cache_slots = cat25256_arena_alloc(arena, config->cache_slots * sizeof(cat25256_cache_slot_t));
+    }
+    if (config->pack_pages > 0) {
+        layout->pack_offsets = cat25256_arena_alloc(arena, config->pack_records * sizeof(uint16_t));
+        layout->pack_shadow = cat25256_arena_alloc(arena, (size_t) config->pack_pages * PAGE_SIZE);
+        layout->pack_dirty = cat25256_arena_alloc(arena, (config->pack_pages + 7) / 8);
+    }
+    if (config->delta_size > 0) {
+        layout->delta_workspace = cat25256_arena_alloc(arena, CAT25256_DELTA_REGION_SIZE(
+                (size_t) config->delta_size, (size_t) config->delta_log_size));
+    }
+    if (config->schema_image_size > 0) {
+        layout->schema_image = cat25256_arena_alloc(arena, config->schema_image_size);
+    }
+    if (config->limit_staging_size > 0) {
+        layout->limit_staging = cat25256_arena_alloc(arena, config->limit_staging_size);
+    }
+    if (config->readahead_size > 0) {
+        layout->readahead_buffer = cat25256_arena_alloc(arena, config->readahead_size);
+    }
+    return MEMORY_STATUS_OK;
+}
@@ -0,0 +1,124 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAT25256_ARENA_H
+#define _CAT25256_ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cat25256.h"
+#include "cat25256_partition.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAT25256_ARENA_ALIGN 8
+
+/**
+ * A user provided static memory region the driver carves its buffers from, nothing is ever freed
+ */
+typedef struct {
+    uint8_t *base;
+    size_t size;
+    size_t used;
+} cat25256_arena_t;
+
+/**
+ * The feature set to reserve buffers for, 0 disables a feature
+ */
+typedef struct {
+    uint16_t wear_pages;
+    uint8_t cache_slots;
+    uint16_t pack_pages;
+    uint16_t pack_records;
+    uint16_t delta_size;
+    uint32_t delta_log_size;
+    uint32_t schema_image_size;
+    uint32_t limit_staging_size;
+    uint16_t readahead_size;
+} cat25256_arena_config_t;
+
+/**
+ * Bytes needed per feature, including alignment padding
+ */
+typedef struct {
+    size_t wear;
+    size_t cache;
+    size_t pack;
+    size_t delta;
+    size_t schema;
+    size_t limit;
+    size_t readahead;
+    size_t total;
+} cat25256_arena_sizes_t;
+
+/**
+ * The buffers carved for a feature set, NULL for disabled features
+ * Hand them to the corresponding module, e.g. wear_counters to cat25256_wear_t.counters.
+ */
+typedef struct {
+    uint32_t *wear_counters;
+    cat25256_cache_slot_t *cache_slots;
+    uint16_t *pack_offsets;
+    uint8_t *pack_shadow;
+    uint8_t *pack_dirty;
+    uint8_t *delta_workspace;
+    uint8_t *schema_image;
+    uint8_t *limit_staging;
+    uint8_t *readahead_buffer;
+} cat25256_arena_layout_t;
+
+/**
+ * @brief Initializes an arena over a static memory region.
+ * @param arena The arena
+ * @param memory The memory region
+ * @param size The size of the memory region
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_arena_init(cat25256_arena_t *arena, void *memory, size_t size);
+
+/**
+ * @brief Takes a zeroed block from the arena.
+ * @param arena The arena
+ * @param size The size of the block
+ * @return The block, NULL if the arena is exhausted
+ */
+void *cat25256_arena_alloc(cat25256_arena_t *arena, size_t size);
+
+/**
+ * @brief Reports how much arena memory a feature set needs.
+ * @param config The feature set
+ * @param sizes The bytes needed per feature, may be NULL
+ * @return The total number of bytes needed
+ */
+size_t cat25256_arena_size_query(const cat25256_arena_config_t *config, cat25256_arena_sizes_t *sizes);
+
+/**
+ * @brief Carves all buffers of a feature set out of the arena.
+ * @param arena The arena
+ * @param config The feature set
+ * @param layout The carved buffers
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK if the arena is too small
+ */
+memory_status_t
+cat25256_arena_carve(cat25256_arena_t *arena, const cat25256_arena_config_t *config, cat25256_arena_layout_t *layout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_CAT25256_ARENA_H
@@ -0,0 +1,170 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "cat25256_batch.h"
+#include "cat25256_cost.h"
+
+#define READ_HEADER_SIZE 3
+
+static uint32_t cat25256_batch_now(const cat25256_batch_t *batch) {
+    cat25256_handle_t *handle = batch->handle;
+    return handle->get_time_us != NULL ? handle->get_time_us(handle->low_level_handle) : 0;
+}
+
+static uint32_t cat25256_batch_bus_time(const cat25256_batch_t *batch, uint32_t bytes, uint32_t transactions) {
+    uint64_t clock = batch->handle->spi_clock_hz != 0 ? batch->handle->spi_clock_hz : CAT25256_DEFAULT_SPI_CLOCK_HZ;
+    uint64_t bits = (uint64_t) bytes * 8 * 1000000u;
+    return (uint32_t) ((bits + clock - 1) / clock) + transactions * CAT25256_TRANSACTION_OVERHEAD_US;
+}
+
+static uint32_t cat25256_batch_capacity(const cat25256_batch_t *batch) {
+    return batch->handle->capacity != 0 ? batch->handle->capacity : CAT25256_CAPACITY;
+}
+
+/**
+ * A read that wraps around the end of the device takes a second transaction from address 0
+ */
+static uint32_t cat25256_batch_transactions(const cat25256_batch_t *batch, uint32_t address, uint32_t length) {
+    uint32_t capacity = cat25256_batch_capacity(batch);
+    return address % capacity + length > capacity ? 2 : 1;
+}
+
+static void cat25256_batch_complete(cat25256_batch_t *batch, size_t first, size_t last, memory_status_t status) {
+    uint32_t now = cat25256_batch_now(batch);
+    for (size_t i = first; i < last; i++) {
+        cat25256_read_request_t *request = batch->queue[i];
+        request->status = status;
+        request->done = 1;
+
+        uint32_t latency = now - request->submitted_us;
+        batch->stats.latency_total_us += latency;
+        if (latency > batch->stats.latency_max_us) {
+            batch->stats.latency_max_us = latency;
+        }
+    }
+}
+
+memory_status_t cat25256_batch_submit(cat25256_batch_t *batch, cat25256_read_request_t *request) {
+    if (batch == NULL || batch->handle == NULL || batch->queue == NULL || batch->capacity == 0 || request == NULL) {
+        return MEMORY_STATUS_NOK;
+    }
+    if (request->data == NULL && request->length > 0) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    if (batch->count == batch->capacity) {
+        // The requests of the flushed batch report their own status
+        cat25256_batch_flush(batch);
+    }
+
+    request->done = 0;
+    request->status = MEMORY_STATUS_NOK;
+    request->submitted_us = cat25256_batch_now(batch);
+    if (batch->count == 0) {
+        batch->opened_us = request->submitted_us;
+    }
+    batch->queue[batch->count++] = request;
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t cat25256_batch_poll(cat25256_batch_t *batch) {
+    if (batch == NULL || batch->handle == NULL) {
+        return MEMORY_STATUS_NOK;
+    }
+    if (batch->count == 0 || cat25256_batch_now(batch) - batch->opened_us < batch->window_us) {
+        return MEMORY_STATUS_OK;
+    }
+    return cat25256_batch_flush(batch);
+}
+
+memory_status_t cat25256_batch_flush(cat25256_batch_t *batch) {
+    if (batch == NULL || batch->handle == NULL) {
+        return MEMORY_STATUS_NOK;
+    }
+    uint32_t max_gap = batch->max_gap != 0 ? batch->max_gap : CAT25256_BATCH_MAX_GAP;
+
+    // Insertion sort by address, the queue is short
+    cat25256_read_request_t **queue = batch->queue;
+    for (size_t i = 1; i < batch->count; i++) {
+        cat25256_read_request_t *request = queue[i];
+        size_t j = i;
+        while (j > 0 && queue[j - 1]->address > request->address) {
+            queue[j] = queue[j - 1];
+            j--;
+        }
+        queue[j] = request;
+    }
+
+    uint8_t burst[CAT25256_BATCH_BURST_SIZE];
+    uint32_t capacity = cat25256_batch_capacity(batch);
+    memory_status_t result = MEMORY_STATUS_OK;
+    size_t first = 0;
+    while (first < batch->count) {
+        uint32_t start = queue[first]->address;
+        uint32_t end = start + queue[first]->length;
+        size_t last = first + 1;
+        // Merging across the end of the device would wrap or reject the whole burst
+        while (last < batch->count && end - start <= sizeof burst && end <= capacity) {
+            uint32_t request_end = queue[last]->address + queue[last]->length;
+            uint32_t new_end = request_end > end ? request_end : end;
+            if (queue[last]->address > end + max_gap || new_end - start > sizeof burst || new_end > capacity) {
+                break;
+            }
+            end = new_end;
+            last++;
+        }
+
+        memory_status_t rc;
+        if (last == first + 1) {
+            // A lone request is read straight into its buffer
+            rc = cat25256_read(batch->handle, start, queue[first]->data, queue[first]->length, batch->cs);
+        } else {
+            rc = cat25256_read(batch->handle, start, burst, end - start, batch->cs);
+            if (rc == MEMORY_STATUS_OK) {
+                for (size_t i = first; i < last; i++) {
+                    memcpy(queue[i]->data, &burst[queue[i]->address - start], queue[i]->length);
+                }
+            }
+        }
+        if (rc != MEMORY_STATUS_OK && result == MEMORY_STATUS_OK) {
+            result = rc;
+        }
+
+        uint32_t transactions = cat25256_batch_transactions(batch, start, end - start);
+        batch->stats.bursts++;
+        batch->stats.bus_bytes += transactions * READ_HEADER_SIZE + end - start;
+        batch->stats.bus_time_us +=
+                cat25256_batch_bus_time(batch, transactions * READ_HEADER_SIZE + end - start, transactions);
+        for (size_t i = first; i < last; i++) {
+            transactions = cat25256_batch_transactions(batch, queue[i]->address, queue[i]->length);
+            uint32_t bytes = transactions * READ_HEADER_SIZE + queue[i]->length;
+            uint32_t time_us = cat25256_batch_bus_time(batch, bytes, transactions);
+            batch->stats.requests++;
+            batch->stats.unbatched_bus_bytes += bytes;
+            batch->stats.unbatched_bus_time_us += time_us;
+            batch->stats.unbatched_latency_total_us += time_us;
+            if (time_us > batch->stats.unbatched_latency_max_us) {
+                batch->stats.unbatched_latency_max_us = time_us;
+            }
+        }
+        cat25256_batch_complete(batch, first, last, rc);
+        first = last;
+    }
+
+    batch->count = 0;
+    return result;
+}
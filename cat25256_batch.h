@@ -0,0 +1,118 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAT25256_BATCH_H
+#define _CAT25256_BATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cat25256.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Largest gap in bytes a merged burst reads through, see CAT25256_GATHER_MAX_GAP
+ */
+#ifndef CAT25256_BATCH_MAX_GAP
+#define CAT25256_BATCH_MAX_GAP 3
+#endif
+
+/**
+ * Longest merged burst, it is staged on the stack. Longer requests are read on their own.
+ */
+#ifndef CAT25256_BATCH_BURST_SIZE
+#define CAT25256_BATCH_BURST_SIZE 128
+#endif
+
+/**
+ * A read owned by the caller. done and status are set once the batch has been flushed.
+ */
+typedef struct {
+    uint32_t address;
+    uint8_t *data;
+    uint32_t length;
+
+    uint32_t submitted_us;
+    uint8_t done;
+    memory_status_t status;
+} cat25256_read_request_t;
+
+/**
+ * Bus traffic of the merged reads against the same requests issued one by one.
+ * The latency runs from submit to completion on the clock of the handle. Unbatched requests never run, their
+ * latency is the bus time of each read on its own, issued at submit on an idle bus.
+ */
+typedef struct {
+    uint32_t requests;
+    uint32_t bursts;
+    uint32_t bus_bytes;
+    uint32_t unbatched_bus_bytes;
+    uint32_t bus_time_us;
+    uint32_t unbatched_bus_time_us;
+    uint32_t latency_total_us;
+    uint32_t latency_max_us;
+    uint32_t unbatched_latency_total_us;
+    uint32_t unbatched_latency_max_us;
+} cat25256_batch_stats_t;
+
+/**
+ * A read batch of one chip
+ * Configure handle, cs, queue (capacity request pointers), window_us and max_gap (0 selects
+ * CAT25256_BATCH_MAX_GAP). The remaining members are maintained by the batch.
+ * Bursts never cross the end of the device, requests that do are read on their own.
+ */
+typedef struct {
+    cat25256_handle_t *handle;
+    size_t cs;
+    cat25256_read_request_t **queue;
+    size_t capacity;
+    uint32_t window_us;
+    uint32_t max_gap;
+
+    size_t count;
+    uint32_t opened_us;
+    cat25256_batch_stats_t stats;
+} cat25256_batch_t;
+
+/**
+ * @brief Queues a read. A full queue is flushed first.
+ * @param batch The batch
+ * @param request The read, must stay valid until it is done
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_batch_submit(cat25256_batch_t *batch, cat25256_read_request_t *request);
+
+/**
+ * @brief Flushes the queue once the oldest request has waited window_us. Requires get_time_us on the handle.
+ * @param batch The batch
+ * @return MEMORY_STATUS_OK on success, the status of the first failing burst otherwise
+ */
+memory_status_t cat25256_batch_poll(cat25256_batch_t *batch);
+
+/**
+ * @brief Merges the queued reads into bursts, reads them and scatters the data back to the requests.
+ * @param batch The batch
+ * @return MEMORY_STATUS_OK on success, the status of the first failing burst otherwise
+ */
+memory_status_t cat25256_batch_flush(cat25256_batch_t *batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_CAT25256_BATCH_H
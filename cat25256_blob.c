@@ -0,0 +1,322 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "cat25256_blob.h"
+#include "cat25256_crc.h"
+
+#define PAGE_SIZE   CAT25256_PAGE_SIZE
+#define MIN_MATCH   3
+#define MAX_MATCH   (MIN_MATCH + 15)
+#define GROUP_SIZE  (1 + 8 * 2)
+
+/**
+ * Stream format: a flag byte precedes every group of up to 8 items, a set bit marks a back-reference.
+ * Literals are one byte, back-references two: 12 bit distance - 1 and 4 bit length - MIN_MATCH.
+ */
+
+typedef struct {
+    cat25256_handle_t *handle;
+    size_t cs;
+    uint32_t address;
+    uint32_t capacity;
+    uint32_t position;
+    uint8_t head[PAGE_SIZE];
+    uint8_t page[PAGE_SIZE];
+    uint32_t head_length;
+    uint32_t page_length;
+    uint32_t limit;
+    uint8_t dry_run;
+    memory_status_t rc;
+} cat25256_blob_writer_t;
+
+static void cat25256_blob_put16(uint8_t *data, uint16_t value) {
+    data[0] = value;
+    data[1] = value >> 8;
+}
+
+static uint16_t cat25256_blob_get16(const uint8_t *data) {
+    return (uint16_t) (data[0] | data[1] << 8);
+}
+
+/**
+ * Appends bytes to the blob. The first page is held back for the header, every following page is
+ * programmed as soon as it is full. A dry run only counts the bytes.
+ */
+static void cat25256_blob_emit(cat25256_blob_writer_t *writer, const uint8_t *data, uint32_t length) {
+    if (writer->dry_run) {
+        writer->position += length;
+        return;
+    }
+
+    for (uint32_t i = 0; i < length && writer->rc == MEMORY_STATUS_OK; ++i) {
+        if (writer->position >= writer->capacity) {
+            writer->rc = MEMORY_STATUS_NOK;
+            return;
+        }
+
+        uint32_t head_size = PAGE_SIZE - writer->address % PAGE_SIZE;
+        if (writer->position < head_size) {
+            writer->head[writer->head_length++] = data[i];
+        } else {
+            writer->page[writer->page_length++] = data[i];
+            uint32_t page_start = writer->address + writer->position + 1 - writer->page_length;
+            if (writer->page_length == PAGE_SIZE) {
+                writer->rc = cat25256_write_page(writer->handle, page_start, writer->page, PAGE_SIZE, writer->cs);
+                writer->page_length = 0;
+            }
+        }
+        writer->position++;
+    }
+}
+
+static memory_status_t cat25256_blob_finish(cat25256_blob_writer_t *writer, const uint8_t *header) {
+    if (writer->rc != MEMORY_STATUS_OK) {
+        return writer->rc;
+    }
+    if (writer->page_length > 0) {
+        uint32_t page_start = writer->address + writer->position - writer->page_length;
+        memory_status_t rc = cat25256_write_page(writer->handle, page_start, writer->page, writer->page_length,
+                                                 writer->cs);
+        if (rc != MEMORY_STATUS_OK) {
+            return rc;
+        }
+    }
+
+    // The header goes last, a torn blob never looks valid
+    memcpy(writer->head, header, CAT25256_BLOB_HEADER_SIZE);
+    return cat25256_write_page(writer->handle, writer->address, writer->head, writer->head_length, writer->cs);
+}
+
+static void cat25256_blob_reset(cat25256_blob_writer_t *writer, uint8_t dry_run) {
+    writer->dry_run = dry_run;
+    writer->position = 0;
+    writer->head_length = 0;
+    writer->page_length = 0;
+    writer->rc = MEMORY_STATUS_OK;
+
+    uint8_t placeholder[CAT25256_BLOB_HEADER_SIZE] = {0};
+    cat25256_blob_emit(writer, placeholder, sizeof placeholder);
+}
+
+static void cat25256_blob_compress(cat25256_blob_writer_t *writer, const uint8_t *data, uint32_t length) {
+    uint8_t group[GROUP_SIZE];
+    uint32_t group_length = 1;
+    uint8_t items = 0;
+    group[0] = 0;
+
+    uint32_t position = 0;
+    while (position < length && writer->rc == MEMORY_STATUS_OK && writer->position < writer->limit) {
+        uint32_t best_length = 0;
+        uint32_t best_distance = 0;
+        uint32_t window_start = position > CAT25256_BLOB_WINDOW ? position - CAT25256_BLOB_WINDOW : 0;
+        uint32_t limit = length - position < MAX_MATCH ? length - position : MAX_MATCH;
+
+        for (uint32_t candidate = window_start; candidate < position; ++candidate) {
+            uint32_t match = 0;
+            while (match < limit && data[candidate + match] == data[position + match]) {
+                match++;
+            }
+            if (match > best_length) {
+                best_length = match;
+                best_distance = position - candidate;
+                if (match == limit) {
+                    break;
+                }
+            }
+        }
+
+        if (best_length >= MIN_MATCH) {
+            uint16_t token = (uint16_t) ((best_distance - 1) << 4 | (best_length - MIN_MATCH));
+            group[0] |= 1 << items;
+            group[group_length++] = token >> 8;
+            group[group_length++] = token;
+            position += best_length;
+        } else {
+            group[group_length++] = data[position++];
+        }
+
+        if (++items == 8) {
+            cat25256_blob_emit(writer, group, group_length);
+            group[0] = 0;
+            group_length = 1;
+            items = 0;
+        }
+    }
+
+    if (items > 0) {
+        cat25256_blob_emit(writer, group, group_length);
+    }
+}
+
+memory_status_t
+cat25256_blob_write(cat25256_handle_t *handle, uint32_t address, uint32_t capacity, const uint8_t *data,
+                    uint32_t length, uint32_t *stored, size_t cs) {
+    if (handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+    if ((data == NULL && length > 0) || length > UINT16_MAX || capacity < CAT25256_BLOB_HEADER_SIZE ||
+        address % PAGE_SIZE > PAGE_SIZE - CAT25256_BLOB_HEADER_SIZE) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    cat25256_blob_writer_t writer = {.handle = handle, .cs = cs, .address = address, .capacity = capacity};
+    cat25256_blob_method_t method = CAT25256_BLOB_LZSS;
+
+    // Size the compressed stream first, so incompressible data never costs wasted page programs
+    writer.limit = CAT25256_BLOB_HEADER_SIZE + length;
+    cat25256_blob_reset(&writer, 1);
+    cat25256_blob_compress(&writer, data, length);
+    if (writer.position >= writer.limit) {
+        method = CAT25256_BLOB_RAW;
+    }
+
+    uint32_t size = method == CAT25256_BLOB_RAW ? CAT25256_BLOB_HEADER_SIZE + length : writer.position;
+    if (size > capacity) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    writer.limit = capacity;
+    cat25256_blob_reset(&writer, 0);
+    if (method == CAT25256_BLOB_RAW) {
+        cat25256_blob_emit(&writer, data, length);
+    } else {
+        cat25256_blob_compress(&writer, data, length);
+    }
+
+    uint8_t header[CAT25256_BLOB_HEADER_SIZE];
+    cat25256_blob_put16(&header[0], CAT25256_BLOB_MAGIC);
+    header[2] = method;
+    header[3] = 0;
+    cat25256_blob_put16(&header[4], (uint16_t) length);
+    cat25256_blob_put16(&header[6], (uint16_t) (writer.position - CAT25256_BLOB_HEADER_SIZE));
+    cat25256_blob_put16(&header[8], cat25256_crc16(CAT25256_CRC16_INIT, data, length));
+
+    memory_status_t rc = cat25256_blob_finish(&writer, header);
+    if (rc == MEMORY_STATUS_OK && stored != NULL) {
+        *stored = writer.position;
+    }
+    return rc;
+}
+
+typedef struct {
+    cat25256_handle_t *handle;
+    size_t cs;
+    uint32_t address;
+    uint32_t remaining;
+    uint8_t chunk[CAT25256_BLOB_CHUNK];
+    uint32_t chunk_length;
+    uint32_t chunk_position;
+} cat25256_blob_reader_t;
+
+static memory_status_t cat25256_blob_next(cat25256_blob_reader_t *reader, uint8_t *value) {
+    if (reader->chunk_position == reader->chunk_length) {
+        if (reader->remaining == 0) {
+            return MEMORY_STATUS_NOK;
+        }
+        uint32_t length = reader->remaining < CAT25256_BLOB_CHUNK ? reader->remaining : CAT25256_BLOB_CHUNK;
+        memory_status_t rc = cat25256_read(reader->handle, reader->address, reader->chunk, length, reader->cs);
+        if (rc != MEMORY_STATUS_OK) {
+            return rc;
+        }
+        reader->address += length;
+        reader->remaining -= length;
+        reader->chunk_length = length;
+        reader->chunk_position = 0;
+    }
+
+    *value = reader->chunk[reader->chunk_position++];
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t
+cat25256_blob_read(cat25256_handle_t *handle, uint32_t address, uint8_t *data, uint32_t capacity, uint32_t *length,
+                   size_t cs) {
+    if (handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+    if (data == NULL || length == NULL) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    uint8_t header[CAT25256_BLOB_HEADER_SIZE];
+    memory_status_t rc = cat25256_read(handle, address, header, sizeof header, cs);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
+    uint32_t raw_length = cat25256_blob_get16(&header[4]);
+    uint32_t stored_length = cat25256_blob_get16(&header[6]);
+    if (cat25256_blob_get16(&header[0]) != CAT25256_BLOB_MAGIC || raw_length > capacity) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    if (header[2] == CAT25256_BLOB_RAW) {
+        if (stored_length != raw_length) {
+            return MEMORY_STATUS_NOK;
+        }
+        rc = cat25256_read(handle, address + CAT25256_BLOB_HEADER_SIZE, data, raw_length, cs);
+        if (rc != MEMORY_STATUS_OK) {
+            return rc;
+        }
+    } else if (header[2] == CAT25256_BLOB_LZSS) {
+        cat25256_blob_reader_t reader = {
+                .handle = handle, .cs = cs,
+                .address = address + CAT25256_BLOB_HEADER_SIZE, .remaining = stored_length,
+        };
+
+        // The output buffer doubles as the back-reference window
+        uint32_t position = 0;
+        while (position < raw_length) {
+            uint8_t flags;
+            if (cat25256_blob_next(&reader, &flags) != MEMORY_STATUS_OK) {
+                return MEMORY_STATUS_NOK;
+            }
+            for (uint8_t item = 0; item < 8 && position < raw_length; ++item) {
+                uint8_t first;
+                if (cat25256_blob_next(&reader, &first) != MEMORY_STATUS_OK) {
+                    return MEMORY_STATUS_NOK;
+                }
+                if (!(flags & (1 << item))) {
+                    data[position++] = first;
+                    continue;
+                }
+
+                uint8_t second;
+                if (cat25256_blob_next(&reader, &second) != MEMORY_STATUS_OK) {
+                    return MEMORY_STATUS_NOK;
+                }
+                uint32_t distance = ((uint32_t) first << 4 | second >> 4) + 1;
+                uint32_t match = (second & 0x0F) + MIN_MATCH;
+                if (distance > position || position + match > raw_length) {
+                    return MEMORY_STATUS_NOK;
+                }
+                for (uint32_t i = 0; i < match; ++i, ++position) {
+                    data[position] = data[position - distance];
+                }
+            }
+        }
+    } else {
+        return MEMORY_STATUS_NOK;
+    }
+
+    if (cat25256_crc16(CAT25256_CRC16_INIT, data, raw_length) != cat25256_blob_get16(&header[8])) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    *length = raw_length;
+    return MEMORY_STATUS_OK;
+}
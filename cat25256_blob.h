@@ -0,0 +1,84 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAT25256_BLOB_H
+#define _CAT25256_BLOB_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cat25256.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Codec tuning: LZSS back-reference window (at most 4096) and the burst size used while decompressing
+ */
+#ifndef CAT25256_BLOB_WINDOW
+#define CAT25256_BLOB_WINDOW 256
+#endif
+
+#ifndef CAT25256_BLOB_CHUNK
+#define CAT25256_BLOB_CHUNK 32
+#endif
+
+#define CAT25256_BLOB_MAGIC        0xC5B1
+#define CAT25256_BLOB_HEADER_SIZE  10
+
+/**
+ * How the payload of a blob is stored
+ */
+typedef enum {
+    CAT25256_BLOB_RAW = 0,
+    CAT25256_BLOB_LZSS
+} cat25256_blob_method_t;
+
+/**
+ * @brief Compresses data and stores it as a blob, incompressible data is stored raw.
+ * Compression streams through two page buffers, the RAM needed is fixed.
+ * @param handle The cat25256_handle_t to use
+ * @param address The address of the blob, its header must not cross a page
+ * @param capacity The space reserved for the blob, including its header
+ * @param data The data to store
+ * @param length The length of the data, at most 65535 bytes
+ * @param stored The number of bytes programmed including the header, may be NULL
+ * @param cs The chip select to use
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure or if the blob does not fit
+ */
+memory_status_t
+cat25256_blob_write(cat25256_handle_t *handle, uint32_t address, uint32_t capacity, const uint8_t *data,
+                    uint32_t length, uint32_t *stored, size_t cs);
+
+/**
+ * @brief Reads and decompresses a blob in CAT25256_BLOB_CHUNK sized bursts.
+ * @param handle The cat25256_handle_t to use
+ * @param address The address of the blob
+ * @param data The buffer to decompress into
+ * @param capacity The size of the buffer
+ * @param length The length of the decompressed data
+ * @param cs The chip select to use
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure, a corrupt blob or a too small buffer
+ */
+memory_status_t
+cat25256_blob_read(cat25256_handle_t *handle, uint32_t address, uint8_t *data, uint32_t capacity, uint32_t *length,
+                   size_t cs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_CAT25256_BLOB_H
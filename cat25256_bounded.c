@@ -0,0 +1,132 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include "cat25256_bounded.h"
+#include "cat25256_cost.h"
+
+#define NREADY 0x01
+
+memory_status_t
+cat25256_write_bounded_begin(cat25256_write_token_t *token, uint32_t address, const uint8_t *data, uint32_t length) {
+    if (token == NULL || (data == NULL && length > 0)) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    token->address = address;
+    token->data = data;
+    token->remaining = length;
+    token->in_flight = 0;
+    return MEMORY_STATUS_OK;
+}
+
+static void cat25256_bounded_complete(cat25256_write_token_t *token) {
+    token->address += token->in_flight;
+    token->data += token->in_flight;
+    token->remaining -= token->in_flight;
+    token->in_flight = 0;
+}
+
+memory_status_t
+cat25256_write_bounded(cat25256_handle_t *handle, cat25256_write_token_t *token, const cat25256_budget_t *budget,
+                       size_t cs) {
+    if (handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+    if (token == NULL || budget == NULL) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    uint8_t measured = handle->get_time_us != NULL;
+    uint32_t start = measured ? handle->get_time_us(handle->low_level_handle) : 0;
+    uint32_t spent = 0;
+    uint32_t pages = 0;
+    uint32_t worst_cycle_us = handle->write_cycle_us != 0 ? handle->write_cycle_us : CAT25256_DEFAULT_WRITE_CYCLE_US;
+    uint8_t wait = 0;
+
+    cat25256_cost_t poll;
+    memory_status_t rc = cat25256_estimate_read_register(handle, &poll, cs);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
+    while (1) {
+        if (token->in_flight > 0) {
+            // A page program is running: poll through it if allowed, otherwise look once and come back later
+            uint8_t status = NREADY;
+            do {
+                if (cat25256_read_register(handle, &status, cs) != MEMORY_STATUS_OK) {
+                    return MEMORY_STATUS_NOK;
+                }
+            } while (wait && (status & NREADY));
+            if (status & NREADY) {
+                return MEMORY_STATUS_OK;
+            }
+            cat25256_bounded_complete(token);
+            if (!measured) {
+                // Without a time base charge the worst case, the final poll is part of the transfer estimate
+                spent += wait ? worst_cycle_us : poll.time_us;
+            }
+        }
+
+        if (token->remaining == 0 || (budget->pages != 0 && pages >= budget->pages)) {
+            return MEMORY_STATUS_OK;
+        }
+
+        uint32_t chunk = CAT25256_PAGE_SIZE - token->address % CAT25256_PAGE_SIZE;
+        if (chunk > token->remaining) {
+            chunk = token->remaining;
+        }
+
+        // Only the transfer has to fit, the write cycle runs on after the call returns
+        cat25256_cost_t cost;
+        rc = cat25256_estimate_write_page(handle, token->address, chunk, &cost, cs);
+        if (rc != MEMORY_STATUS_OK) {
+            return rc;
+        }
+        uint32_t transfer_us = cost.time_us - cat25256_cost_write_cycle_us(handle, cs);
+
+        if (budget->time_us != 0) {
+            if (transfer_us > budget->time_us) {
+                // No call could ever start this page
+                return MEMORY_STATUS_NOK;
+            }
+            if (measured) {
+                spent = handle->get_time_us(handle->low_level_handle) - start;
+            }
+            if (spent + transfer_us > budget->time_us) {
+                return MEMORY_STATUS_OK;
+            }
+        }
+
+        rc = cat25256_write_page_start(handle, token->address, token->data, chunk, cs);
+        if (rc != MEMORY_STATUS_OK) {
+            return rc;
+        }
+        token->in_flight = chunk;
+        spent += transfer_us;
+        pages++;
+
+        // Wait for the program in this call only if even the slowest write cycle ends within the budget.
+        // A measured time ends before the final poll, an estimated one includes it.
+        uint32_t ahead = 0;
+        if (measured) {
+            spent = handle->get_time_us(handle->low_level_handle) - start;
+            ahead = poll.time_us;
+        }
+        wait = budget->time_us == 0 || spent + worst_cycle_us + ahead <= budget->time_us;
+    }
+}
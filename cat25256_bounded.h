@@ -0,0 +1,81 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAT25256_BOUNDED_H
+#define _CAT25256_BOUNDED_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cat25256.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Work budget of a single call, a member of 0 does not limit
+ */
+typedef struct {
+    uint32_t time_us;
+    uint32_t pages;
+} cat25256_budget_t;
+
+/**
+ * Continuation of a bounded write, remaining is 0 once the write has completed
+ * in_flight is the length of a page program started by an earlier call whose write cycle has not been seen
+ * to complete yet, the chip is busy until then.
+ */
+typedef struct {
+    uint32_t address;
+    const uint8_t *data;
+    uint32_t remaining;
+    uint32_t in_flight;
+} cat25256_write_token_t;
+
+/**
+ * @brief Prepares a bounded write, no bus traffic is issued.
+ * @param token The continuation token to initialize
+ * @param address The address to write to
+ * @param data The data buffer to write, must stay valid until the write has completed
+ * @param length The length of the data buffer
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t
+cat25256_write_bounded_begin(cat25256_write_token_t *token, uint32_t address, const uint8_t *data, uint32_t length);
+
+/**
+ * @brief Advances a bounded write as far as the budget allows.
+ * A page program is started if the cost model predicts that its transfer fits into the rest of the budget.
+ * The call polls it to completion only if the worst-case tWC (write_cycle_us of the handle) fits as well,
+ * otherwise it returns with the program in flight and the next call polls its status first.
+ * With get_time_us the time spent is measured, without it the call charges the cost model's transfer estimates
+ * and the worst-case tWC of every program it waits for.
+ * @param handle The cat25256_handle_t to use
+ * @param token The continuation token, advanced past the completed pages
+ * @param budget The budget of this call
+ * @param cs The chip select to use
+ * @return MEMORY_STATUS_OK on progress or while a program is in flight, MEMORY_STATUS_NOK on failure or if
+ * the transfer of a single page exceeds the time budget
+ */
+memory_status_t
+cat25256_write_bounded(cat25256_handle_t *handle, cat25256_write_token_t *token, const cat25256_budget_t *budget,
+                       size_t cs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_CAT25256_BOUNDED_H
@@ -0,0 +1,245 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include "cat25256_cost.h"
+
+#define HEADER_SIZE      3
+#define COMMAND_SIZE     1
+#define REGISTER_SIZE    2
+
+static uint32_t cat25256_cost_bus_us(const cat25256_handle_t *handle, uint32_t bytes, uint32_t transactions) {
+    uint32_t clock = handle->spi_clock_hz != 0 ? handle->spi_clock_hz : CAT25256_DEFAULT_SPI_CLOCK_HZ;
+    uint64_t bits = (uint64_t) bytes * 8 * 1000000;
+    return (uint32_t) ((bits + clock - 1) / clock) + transactions * CAT25256_TRANSACTION_OVERHEAD_US;
+}
+
+uint32_t cat25256_cost_write_cycle_us(const cat25256_handle_t *handle, size_t cs) {
+    if (cs < CAT25256_MAX_CS && handle->chip[cs].write_cycle_us != 0) {
+        return handle->chip[cs].write_cycle_us;
+    }
+    return handle->write_cycle_us != 0 ? handle->write_cycle_us : CAT25256_DEFAULT_WRITE_CYCLE_US;
+}
+
+static uint32_t cat25256_cost_status_polls(const cat25256_handle_t *handle, size_t cs) {
+    uint32_t write_cycle = cat25256_cost_write_cycle_us(handle, cs);
+    uint32_t poll_us = cat25256_cost_bus_us(handle, REGISTER_SIZE, 1) + CAT25256_POLL_INTERVAL_US;
+
+#if CAT25256_FEATURE_ADAPTIVE_WAIT
+    if (handle->get_time_us != NULL && handle->delay_us != NULL && cs < CAT25256_MAX_CS &&
+        handle->chip[cs].write_cycle_us > CAT25256_WAIT_GUARD_US) {
+        // Sleep up to the guard band, then poll through it
+        return CAT25256_WAIT_GUARD_US / poll_us + 1;
+    }
+#endif
+
+    // Polling for the whole write cycle
+    return write_cycle / poll_us + 1;
+}
+
+static uint32_t cat25256_cost_capacity(const cat25256_handle_t *handle) {
+    return handle->capacity != 0 ? handle->capacity : CAT25256_CAPACITY;
+}
+
+/**
+ * Splits an access like cat25256_read and cat25256_write do, the second part starts at address 0
+ */
+static memory_status_t
+cat25256_cost_split(const cat25256_handle_t *handle, uint32_t *address, uint32_t length, uint32_t *first) {
+    uint32_t capacity = cat25256_cost_capacity(handle);
+    *first = length;
+    if (*address < capacity && length <= capacity - *address) {
+        return MEMORY_STATUS_OK;
+    }
+    if (handle->wrap != CAT25256_WRAP_AROUND || length > capacity) {
+        return MEMORY_STATUS_OUT_OF_RANGE;
+    }
+    *address %= capacity;
+    *first = capacity - *address < length ? capacity - *address : length;
+    return MEMORY_STATUS_OK;
+}
+
+/**
+ * The protection check reads the status register once if its shadow is not valid, the polls keep it valid
+ */
+static void cat25256_cost_protection_check(const cat25256_handle_t *handle, cat25256_cost_t *cost, size_t cs) {
+#if CAT25256_FEATURE_PROTECTION_CHECK
+    if (cs < CAT25256_MAX_CS && !handle->chip[cs].status_valid) {
+        cost->bus_bytes += REGISTER_SIZE;
+        cost->transactions++;
+        cost->time_us += cat25256_cost_bus_us(handle, REGISTER_SIZE, 1);
+    }
+#else
+    (void) handle;
+    (void) cost;
+    (void) cs;
+#endif
+}
+
+static void cat25256_cost_page(const cat25256_handle_t *handle, uint32_t length, cat25256_cost_t *cost, size_t cs) {
+    // WREN, WRITE with data, WRDI
+    uint32_t bytes = COMMAND_SIZE + HEADER_SIZE + length + COMMAND_SIZE;
+    uint32_t transactions = 3;
+    if (length == 0) {
+        // The chip starts no write cycle without data, the first poll finds it ready
+        cost->bus_bytes += bytes + REGISTER_SIZE;
+        cost->transactions += transactions + 1;
+        cost->time_us += cat25256_cost_bus_us(handle, bytes + REGISTER_SIZE, transactions + 1);
+        return;
+    }
+    uint32_t polls = cat25256_cost_status_polls(handle, cs);
+
+    cost->bus_bytes += bytes + polls * REGISTER_SIZE;
+    cost->transactions += transactions + polls;
+    cost->page_programs++;
+    // Polling overlaps the write cycle, only the final poll adds to the wall time
+    cost->time_us += cat25256_cost_bus_us(handle, bytes + REGISTER_SIZE, transactions + 1) +
+                     cat25256_cost_write_cycle_us(handle, cs);
+}
+
+static void
+cat25256_cost_range(const cat25256_handle_t *handle, uint32_t address, uint32_t length, cat25256_cost_t *cost,
+                    size_t cs) {
+    while (length > 0) {
+        uint32_t chunk = CAT25256_PAGE_SIZE - address % CAT25256_PAGE_SIZE;
+        if (chunk > length) {
+            chunk = length;
+        }
+        cat25256_cost_page(handle, chunk, cost, cs);
+        address += chunk;
+        length -= chunk;
+    }
+}
+
+/**
+ * Adds a cat25256_write without its protection check
+ */
+static memory_status_t
+cat25256_cost_write(const cat25256_handle_t *handle, uint32_t address, uint32_t length, cat25256_cost_t *cost,
+                    size_t cs) {
+    uint32_t first;
+    memory_status_t rc = cat25256_cost_split(handle, &address, length, &first);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
+    if (length == 0) {
+        // Still runs the command sequence of a page write
+        cat25256_cost_page(handle, 0, cost, cs);
+        return MEMORY_STATUS_OK;
+    }
+    cat25256_cost_range(handle, address, first, cost, cs);
+    cat25256_cost_range(handle, 0, length - first, cost, cs);
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t
+cat25256_estimate_read(cat25256_handle_t *handle, uint32_t address, uint32_t length, cat25256_cost_t *cost, size_t cs) {
+    (void) cs;
+    if (handle == NULL || cost == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+
+    uint32_t first;
+    memory_status_t rc = cat25256_cost_split(handle, &address, length, &first);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
+    // A wrapped read takes a second READ from address 0
+    cost->transactions = first < length ? 2 : 1;
+    cost->bus_bytes = cost->transactions * HEADER_SIZE + length;
+    cost->page_programs = 0;
+    cost->time_us = cat25256_cost_bus_us(handle, cost->bus_bytes, cost->transactions);
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t cat25256_estimate_read_register(cat25256_handle_t *handle, cat25256_cost_t *cost, size_t cs) {
+    (void) cs;
+    if (handle == NULL || cost == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+
+    cost->bus_bytes = REGISTER_SIZE;
+    cost->transactions = 1;
+    cost->page_programs = 0;
+    cost->time_us = cat25256_cost_bus_us(handle, REGISTER_SIZE, 1);
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t
+cat25256_estimate_write_page(cat25256_handle_t *handle, uint32_t address, uint32_t length, cat25256_cost_t *cost,
+                             size_t cs) {
+    if (handle == NULL || cost == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+
+    uint32_t capacity = cat25256_cost_capacity(handle);
+    if (address >= capacity && handle->wrap == CAT25256_WRAP_AROUND) {
+        address %= capacity;
+    }
+    if (address >= capacity || length > capacity - address) {
+        return MEMORY_STATUS_OUT_OF_RANGE;
+    }
+
+    cost->bus_bytes = 0;
+    cost->transactions = 0;
+    cost->page_programs = 0;
+    cost->time_us = 0;
+    cat25256_cost_protection_check(handle, cost, cs);
+    cat25256_cost_page(handle, length, cost, cs);
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t
+cat25256_estimate_write(cat25256_handle_t *handle, uint32_t address, uint32_t length, cat25256_cost_t *cost, size_t cs) {
+    if (handle == NULL || cost == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+
+    cost->bus_bytes = 0;
+    cost->transactions = 0;
+    cost->page_programs = 0;
+    cost->time_us = 0;
+    cat25256_cost_protection_check(handle, cost, cs);
+    return cat25256_cost_write(handle, address, length, cost, cs);
+}
+
+memory_status_t
+cat25256_estimate_write_batch(cat25256_handle_t *handle, const cat25256_segment_t *segments, size_t count,
+                              cat25256_cost_t *cost, size_t cs) {
+    if (handle == NULL || cost == NULL || (segments == NULL && count > 0)) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+
+    cost->bus_bytes = 0;
+    cost->transactions = 0;
+    cost->page_programs = 0;
+    cost->time_us = 0;
+    if (count > 0) {
+        // Only the first write finds the shadow invalid
+        cat25256_cost_protection_check(handle, cost, cs);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        memory_status_t rc = cat25256_cost_write(handle, segments[i].address, segments[i].length, cost, cs);
+        if (rc != MEMORY_STATUS_OK) {
+            return rc;
+        }
+    }
+
+    return MEMORY_STATUS_OK;
+}
@@ -0,0 +1,125 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAT25256_COST_H
+#define _CAT25256_COST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cat25256.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Fixed cost of toggling chip select around a single transaction
+ */
+#ifndef CAT25256_TRANSACTION_OVERHEAD_US
+#define CAT25256_TRANSACTION_OVERHEAD_US 1
+#endif
+
+/**
+ * Predicted cost of an operation, including the split of wrapped accesses and the status register read of the
+ * protection check while the shadow is not valid. Status polls during a write cycle are estimated from tWC.
+ */
+typedef struct {
+    uint32_t bus_bytes;
+    uint32_t transactions;
+    uint32_t page_programs;
+    uint32_t time_us;
+} cat25256_cost_t;
+
+/**
+ * A single write of a batch
+ */
+typedef struct {
+    uint32_t address;
+    uint32_t length;
+} cat25256_segment_t;
+
+/**
+ * @brief Predicts the cost of cat25256_read.
+ * @param handle The cat25256_handle_t providing the timing configuration
+ * @param address The address to read from
+ * @param length The length of the read
+ * @param cost The predicted cost
+ * @param cs The chip select to use
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_OUT_OF_RANGE if the call would be rejected
+ */
+memory_status_t
+cat25256_estimate_read(cat25256_handle_t *handle, uint32_t address, uint32_t length, cat25256_cost_t *cost, size_t cs);
+
+/**
+ * @brief Predicts the cost of cat25256_read_register, e.g. of a single status poll.
+ * @param handle The cat25256_handle_t providing the timing configuration
+ * @param cost The predicted cost
+ * @param cs The chip select to use
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_INVALID_HANDLE on failure
+ */
+memory_status_t cat25256_estimate_read_register(cat25256_handle_t *handle, cat25256_cost_t *cost, size_t cs);
+
+/**
+ * @brief Predicts the cost of cat25256_write_page.
+ * @param handle The cat25256_handle_t providing the timing configuration
+ * @param address The address to write to
+ * @param length The length of the write, must not cross a page
+ * @param cost The predicted cost
+ * @param cs The chip select to use
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_OUT_OF_RANGE if the call would be rejected
+ */
+memory_status_t
+cat25256_estimate_write_page(cat25256_handle_t *handle, uint32_t address, uint32_t length, cat25256_cost_t *cost,
+                             size_t cs);
+
+/**
+ * @brief Predicts the cost of cat25256_write.
+ * @param handle The cat25256_handle_t providing the timing configuration
+ * @param address The address to write to
+ * @param length The length of the write
+ * @param cost The predicted cost
+ * @param cs The chip select to use
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_OUT_OF_RANGE if the call would be rejected
+ */
+memory_status_t
+cat25256_estimate_write(cat25256_handle_t *handle, uint32_t address, uint32_t length, cat25256_cost_t *cost, size_t cs);
+
+/**
+ * @brief Predicts the cost of issuing several cat25256_write calls back to back.
+ * @param handle The cat25256_handle_t providing the timing configuration
+ * @param segments The writes of the batch
+ * @param count The number of segments
+ * @param cost The predicted cost of the whole batch
+ * @param cs The chip select to use
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_OUT_OF_RANGE if the call would be rejected
+ */
+memory_status_t
+cat25256_estimate_write_batch(cat25256_handle_t *handle, const cat25256_segment_t *segments, size_t count,
+                              cat25256_cost_t *cost, size_t cs);
+
+/**
+ * @brief Returns the tWC the cost model uses: the learned estimate if present, the configured value otherwise.
+ * @param handle The cat25256_handle_t providing the timing configuration
+ * @param cs The chip select to use
+ * @return The write-cycle time in microseconds
+ */
+uint32_t cat25256_cost_write_cycle_us(const cat25256_handle_t *handle, size_t cs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_CAT25256_COST_H
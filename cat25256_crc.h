@@ -0,0 +1,42 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAT25256_CRC_H
+#define _CAT25256_CRC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAT25256_CRC16_INIT 0xFFFF
+
+/**
+ * @brief Continues a CRC-16/CCITT-FALSE over a buffer.
+ * @param crc The CRC of the preceding data, CAT25256_CRC16_INIT to start
+ * @param data The data to add
+ * @param length The length of the data
+ * @return The updated CRC
+ */
+uint16_t cat25256_crc16(uint16_t crc, const uint8_t *data, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_CAT25256_CRC_H
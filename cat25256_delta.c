@@ -0,0 +1,272 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "cat25256_delta.h"
+#include "cat25256_crc.h"
+
+#define PAGE_SIZE        CAT25256_PAGE_SIZE
+#define HEADER_SIZE      12
+#define HEADER_SLOT      16
+#define MAX_ENTRY_DATA   255
+#define ENTRY_LAST       0x8000u
+
+/**
+ * Header: magic u16, generation u16, active base u8, reserved u8, size u16, base crc u16, header crc u16
+ * Two header slots alternate by generation, a header torn by a power loss leaves the previous one intact
+ * Entry: length u8, generation u8, offset u16, crc u16 (over the full generation and the entry), data
+ * The top bit of the offset marks the last entry of a commit, a commit torn between its entries is not replayed
+ */
+
+static void cat25256_delta_put16(uint8_t *data, uint16_t value) {
+    data[0] = value;
+    data[1] = value >> 8;
+}
+
+static uint16_t cat25256_delta_get16(const uint8_t *data) {
+    return (uint16_t) (data[0] | data[1] << 8);
+}
+
+static uint32_t cat25256_delta_base_offset(const cat25256_delta_t *store, uint8_t base) {
+    return PAGE_SIZE + base * CAT25256_DELTA_BASE_SIZE(store->size);
+}
+
+static uint32_t cat25256_delta_log_offset(const cat25256_delta_t *store) {
+    return PAGE_SIZE + 2 * CAT25256_DELTA_BASE_SIZE(store->size);
+}
+
+static uint8_t *cat25256_delta_current(const cat25256_delta_t *store) {
+    return &store->workspace[cat25256_delta_base_offset(store, store->active)];
+}
+
+static uint16_t cat25256_delta_entry_crc(const uint8_t *entry, uint16_t generation) {
+    // The full generation is covered, entries left over from a wrapped generation byte never match
+    uint8_t full[2];
+    cat25256_delta_put16(full, generation);
+    uint16_t crc = cat25256_crc16(CAT25256_CRC16_INIT, full, sizeof full);
+    crc = cat25256_crc16(crc, entry, 4);
+    return cat25256_crc16(crc, &entry[CAT25256_DELTA_ENTRY_OVERHEAD], entry[0]);
+}
+
+static int cat25256_delta_header_valid(const cat25256_delta_t *store, const uint8_t *header) {
+    if (cat25256_delta_get16(&header[0]) != CAT25256_DELTA_MAGIC || header[4] > 1 ||
+        cat25256_delta_get16(&header[6]) != store->size ||
+        cat25256_crc16(CAT25256_CRC16_INIT, header, HEADER_SIZE - 2) != cat25256_delta_get16(&header[10])) {
+        return 0;
+    }
+    const uint8_t *base = &store->workspace[cat25256_delta_base_offset(store, header[4])];
+    return cat25256_crc16(CAT25256_CRC16_INIT, base, store->size) == cat25256_delta_get16(&header[8]);
+}
+
+memory_status_t cat25256_delta_load(cat25256_delta_t *store) {
+    if (store == NULL || store->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+    if (store->workspace == NULL || store->size == 0 || store->address % PAGE_SIZE != 0) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    store->valid = 0;
+    store->active = 0;
+    store->entries = 0;
+    store->log_used = 0;
+
+    memory_status_t rc = cat25256_read(store->handle, store->address, store->workspace,
+                                       CAT25256_DELTA_REGION_SIZE(store->size, store->log_size), store->cs);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
+    // The newest slot whose header and base are both intact wins
+    const uint8_t *header = NULL;
+    for (uint32_t slot = 0; slot < 2; slot++) {
+        const uint8_t *candidate = &store->workspace[slot * HEADER_SLOT];
+        if (!cat25256_delta_header_valid(store, candidate)) {
+            continue;
+        }
+        if (header == NULL ||
+            (int16_t) (cat25256_delta_get16(&candidate[2]) - cat25256_delta_get16(&header[2])) > 0) {
+            header = candidate;
+        }
+    }
+    if (header == NULL) {
+        return MEMORY_STATUS_NOK;
+    }
+    store->generation = cat25256_delta_get16(&header[2]);
+    store->active = header[4];
+
+    uint8_t *state = cat25256_delta_current(store);
+
+    // Replay the chain up to the first entry that does not belong to this generation, whole commits only
+    const uint8_t *log = &store->workspace[cat25256_delta_log_offset(store)];
+    uint32_t scanned = 0;
+    uint16_t pending = 0;
+    while (scanned + CAT25256_DELTA_ENTRY_OVERHEAD <= store->log_size) {
+        const uint8_t *entry = &log[scanned];
+        uint32_t length = entry[0];
+        uint32_t offset = cat25256_delta_get16(&entry[2]) & ~ENTRY_LAST;
+        if (length == 0 || entry[1] != (uint8_t) store->generation || offset + length > store->size ||
+            scanned + CAT25256_DELTA_ENTRY_OVERHEAD + length > store->log_size ||
+            cat25256_delta_get16(&entry[4]) != cat25256_delta_entry_crc(entry, store->generation)) {
+            break;
+        }
+
+        scanned += CAT25256_DELTA_ENTRY_OVERHEAD + length;
+        pending++;
+        if (cat25256_delta_get16(&entry[2]) & ENTRY_LAST) {
+            for (uint32_t apply = store->log_used; apply < scanned;) {
+                const uint8_t *done = &log[apply];
+                offset = cat25256_delta_get16(&done[2]) & ~ENTRY_LAST;
+                memcpy(&state[offset], &done[CAT25256_DELTA_ENTRY_OVERHEAD], done[0]);
+                apply += CAT25256_DELTA_ENTRY_OVERHEAD + done[0];
+            }
+            store->log_used = scanned;
+            store->entries += pending;
+            pending = 0;
+        }
+    }
+
+    store->valid = 1;
+    return MEMORY_STATUS_OK;
+}
+
+const uint8_t *cat25256_delta_state(const cat25256_delta_t *store) {
+    if (store == NULL || !store->valid) {
+        return NULL;
+    }
+    return cat25256_delta_current(store);
+}
+
+static memory_status_t cat25256_delta_write_base(cat25256_delta_t *store, const uint8_t *snapshot) {
+    uint8_t next = store->valid ? !store->active : 0;
+    uint16_t generation = store->generation + 1;
+    uint8_t *base = &store->workspace[cat25256_delta_base_offset(store, next)];
+
+    if (base != snapshot) {
+        memcpy(base, snapshot, store->size);
+    }
+    memory_status_t rc = cat25256_write(store->handle, store->address + cat25256_delta_base_offset(store, next),
+                                        base, store->size, store->cs);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
+    // Switching the header retires the old base and every delta of the old generation at once
+    uint8_t *header = &store->workspace[(generation & 1u) * HEADER_SLOT];
+    cat25256_delta_put16(&header[0], CAT25256_DELTA_MAGIC);
+    cat25256_delta_put16(&header[2], generation);
+    header[4] = next;
+    header[5] = 0;
+    cat25256_delta_put16(&header[6], store->size);
+    cat25256_delta_put16(&header[8], cat25256_crc16(CAT25256_CRC16_INIT, base, store->size));
+    cat25256_delta_put16(&header[10], cat25256_crc16(CAT25256_CRC16_INIT, header, HEADER_SIZE - 2));
+    rc = cat25256_write_page(store->handle, store->address + (generation & 1u) * HEADER_SLOT, header, HEADER_SIZE,
+                             store->cs);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
+    store->generation = generation;
+    store->active = next;
+    store->entries = 0;
+    store->log_used = 0;
+    store->valid = 1;
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t cat25256_delta_compact(cat25256_delta_t *store) {
+    if (store == NULL || store->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+    if (!store->valid) {
+        return MEMORY_STATUS_NOK;
+    }
+    return cat25256_delta_write_base(store, cat25256_delta_current(store));
+}
+
+memory_status_t cat25256_delta_commit(cat25256_delta_t *store, const uint8_t *snapshot) {
+    if (store == NULL || store->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+    if (snapshot == NULL || store->workspace == NULL) {
+        return MEMORY_STATUS_NOK;
+    }
+    if (!store->valid) {
+        return cat25256_delta_write_base(store, snapshot);
+    }
+
+    uint8_t *state = cat25256_delta_current(store);
+    uint8_t *log = &store->workspace[cat25256_delta_log_offset(store)];
+    uint32_t append_start = store->log_used;
+    uint32_t append_end = append_start;
+    uint16_t entries = store->entries;
+    uint8_t *entry = NULL;
+
+    // Encode every changed run as an entry, runs closer than an entry header are merged
+    uint32_t position = 0;
+    while (position < store->size) {
+        if (state[position] == snapshot[position]) {
+            position++;
+            continue;
+        }
+
+        uint32_t first = position;
+        uint32_t last = position + 1;
+        for (uint32_t scan = last; scan < store->size && scan - first < MAX_ENTRY_DATA; ++scan) {
+            if (state[scan] != snapshot[scan]) {
+                last = scan + 1;
+            } else if (scan - last >= CAT25256_DELTA_ENTRY_OVERHEAD) {
+                break;
+            }
+        }
+
+        uint32_t length = last - first;
+        if (append_end + CAT25256_DELTA_ENTRY_OVERHEAD + length > store->log_size ||
+            (store->compact_after != 0 && entries >= store->compact_after)) {
+            // The chain is full, the new snapshot becomes the base
+            return cat25256_delta_write_base(store, snapshot);
+        }
+
+        entry = &log[append_end];
+        entry[0] = (uint8_t) length;
+        entry[1] = (uint8_t) store->generation;
+        cat25256_delta_put16(&entry[2], (uint16_t) first);
+        memcpy(&entry[CAT25256_DELTA_ENTRY_OVERHEAD], &snapshot[first], length);
+        cat25256_delta_put16(&entry[4], cat25256_delta_entry_crc(entry, store->generation));
+
+        append_end += CAT25256_DELTA_ENTRY_OVERHEAD + length;
+        entries++;
+        position = last;
+    }
+
+    if (append_end == append_start) {
+        return MEMORY_STATUS_OK;
+    }
+    cat25256_delta_put16(&entry[2], cat25256_delta_get16(&entry[2]) | ENTRY_LAST);
+    cat25256_delta_put16(&entry[4], cat25256_delta_entry_crc(entry, store->generation));
+
+    // All new entries in one write, every touched log page is programmed once
+    memory_status_t rc = cat25256_write(store->handle, store->address + cat25256_delta_log_offset(store) + append_start,
+                                        &log[append_start], append_end - append_start, store->cs);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
+    memcpy(state, snapshot, store->size);
+    store->log_used = append_end;
+    store->entries = entries;
+    return MEMORY_STATUS_OK;
+}
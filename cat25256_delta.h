@@ -0,0 +1,94 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAT25256_DELTA_H
+#define _CAT25256_DELTA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cat25256.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAT25256_DELTA_MAGIC          0xC5D3
+#define CAT25256_DELTA_ENTRY_OVERHEAD 6
+
+#define CAT25256_DELTA_BASE_SIZE(size) \
+    (((size) + CAT25256_PAGE_SIZE - 1) / CAT25256_PAGE_SIZE * CAT25256_PAGE_SIZE)
+
+/**
+ * Size of the region and of the workspace: a header page, two base slots and the delta log
+ */
+#define CAT25256_DELTA_REGION_SIZE(size, log_size) \
+    (CAT25256_PAGE_SIZE + 2 * CAT25256_DELTA_BASE_SIZE(size) + (log_size))
+
+/**
+ * A snapshot of size bytes stored as a base plus a log of (offset, bytes) deltas
+ * The region starts at the page aligned address, workspace holds CAT25256_DELTA_REGION_SIZE bytes.
+ * Once compact_after deltas are chained (0: only when the log is full) the current state becomes the new base.
+ */
+typedef struct {
+    cat25256_handle_t *handle;
+    size_t cs;
+    uint32_t address;
+    uint16_t size;
+    uint32_t log_size;
+    uint16_t compact_after;
+    uint8_t *workspace;
+
+    uint8_t valid;
+    uint8_t active;
+    uint16_t generation;
+    uint16_t entries;
+    uint32_t log_used;
+} cat25256_delta_t;
+
+/**
+ * @brief Reads the region with a single burst read and reconstructs the current state.
+ * @param store The delta store
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure or if no base has been stored yet
+ */
+memory_status_t cat25256_delta_load(cat25256_delta_t *store);
+
+/**
+ * @brief Returns the current state after cat25256_delta_load or cat25256_delta_commit.
+ * @param store The delta store
+ * @return The snapshot of size bytes, NULL if there is none
+ */
+const uint8_t *cat25256_delta_state(const cat25256_delta_t *store);
+
+/**
+ * @brief Persists a new snapshot as deltas against the current state, compacting the chain when needed.
+ * @param store The delta store
+ * @param snapshot The new snapshot of size bytes
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_delta_commit(cat25256_delta_t *store, const uint8_t *snapshot);
+
+/**
+ * @brief Writes the current state as a new base and starts an empty delta chain.
+ * @param store The delta store
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_delta_compact(cat25256_delta_t *store);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_CAT25256_DELTA_H
@@ -0,0 +1,299 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cat25256_dispatch.h"
+
+/**
+ * A piece of work claimed by a worker, a whole job or one stripe of it
+ */
+typedef struct {
+    cat25256_job_t *job;
+    size_t cs;
+    uint32_t offset;
+    uint32_t length;
+} cat25256_claim_t;
+
+static uint8_t cat25256_dispatch_splittable(const cat25256_job_t *job) {
+    return job->type == CAT25256_JOB_READ && job->mirror_count > 0 && job->stripe_size > 0;
+}
+
+static void cat25256_dispatch_unlink(cat25256_bus_t *bus, cat25256_job_t *job) {
+    cat25256_job_t *previous = NULL;
+    for (cat25256_job_t *it = bus->head; it != NULL; previous = it, it = it->next) {
+        if (it != job) {
+            continue;
+        }
+        if (previous == NULL) {
+            bus->head = job->next;
+        } else {
+            previous->next = job->next;
+        }
+        if (bus->tail == job) {
+            bus->tail = previous;
+        }
+        job->next = NULL;
+        return;
+    }
+}
+
+static void cat25256_dispatch_take_stripe(cat25256_bus_t *owner, cat25256_claim_t *claim) {
+    cat25256_job_t *job = claim->job;
+    uint32_t remaining = job->length - job->next_offset;
+    claim->offset = job->next_offset;
+    claim->length = remaining < job->stripe_size ? remaining : job->stripe_size;
+    job->next_offset += claim->length;
+    job->in_flight++;
+    if (job->next_offset == job->length) {
+        // Every stripe is claimed, nothing left to steal
+        cat25256_dispatch_unlink(owner, job);
+    }
+}
+
+/**
+ * Own queue first, then stripes of split reads queued on other buses that have a mirror on this bus
+ */
+static uint8_t cat25256_dispatch_claim(cat25256_dispatcher_t *dispatcher, size_t index, cat25256_claim_t *claim) {
+    cat25256_bus_t *bus = &dispatcher->buses[index];
+    cat25256_job_t *job = bus->head;
+    if (job != NULL) {
+        claim->job = job;
+        claim->cs = job->location.cs;
+        if (cat25256_dispatch_splittable(job)) {
+            cat25256_dispatch_take_stripe(bus, claim);
+        } else {
+            cat25256_dispatch_unlink(bus, job);
+            job->in_flight++;
+            claim->offset = 0;
+            claim->length = job->length;
+        }
+        return 1;
+    }
+
+    for (size_t other = 0; other < dispatcher->bus_count; other++) {
+        if (other == index) {
+            continue;
+        }
+        for (job = dispatcher->buses[other].head; job != NULL; job = job->next) {
+            if (!cat25256_dispatch_splittable(job)) {
+                continue;
+            }
+            for (size_t m = 0; m < job->mirror_count; m++) {
+                if (job->mirrors[m].bus == index) {
+                    claim->job = job;
+                    claim->cs = job->mirrors[m].cs;
+                    cat25256_dispatch_take_stripe(&dispatcher->buses[other], claim);
+                    bus->stolen++;
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static void *cat25256_dispatch_worker(void *argument) {
+    cat25256_bus_t *bus = argument;
+    cat25256_dispatcher_t *dispatcher = bus->dispatcher;
+
+    pthread_mutex_lock(&dispatcher->lock);
+    while (1) {
+        cat25256_claim_t claim;
+        if (!cat25256_dispatch_claim(dispatcher, bus->index, &claim)) {
+            if (!dispatcher->running) {
+                break;
+            }
+            pthread_cond_wait(&bus->wake, &dispatcher->lock);
+            continue;
+        }
+
+        // Only this worker touches the handle of its bus, the stripes of a job never overlap
+        pthread_mutex_unlock(&dispatcher->lock);
+        cat25256_job_t *job = claim.job;
+        memory_status_t rc;
+        if (job->type == CAT25256_JOB_READ) {
+            rc = cat25256_read(bus->handle, job->address + claim.offset, &job->data[claim.offset], claim.length,
+                               claim.cs);
+        } else {
+            rc = cat25256_write(bus->handle, job->address + claim.offset, &job->data[claim.offset], claim.length,
+                                claim.cs);
+        }
+        pthread_mutex_lock(&dispatcher->lock);
+
+        bus->executed++;
+        if (rc != MEMORY_STATUS_OK && job->status == MEMORY_STATUS_OK) {
+            job->status = rc;
+        }
+        job->in_flight--;
+        uint8_t claimed = !cat25256_dispatch_splittable(job) || job->next_offset == job->length;
+        if (claimed && job->in_flight == 0) {
+            job->done = 1;
+            pthread_cond_broadcast(&dispatcher->completed);
+        }
+    }
+    pthread_mutex_unlock(&dispatcher->lock);
+    return NULL;
+}
+
+memory_status_t cat25256_dispatch_start(cat25256_dispatcher_t *dispatcher) {
+    if (dispatcher == NULL || dispatcher->buses == NULL || dispatcher->bus_count == 0) {
+        return MEMORY_STATUS_NOK;
+    }
+    for (size_t i = 0; i < dispatcher->bus_count; i++) {
+        if (dispatcher->buses[i].handle == NULL) {
+            return MEMORY_STATUS_NOK;
+        }
+    }
+
+    if (pthread_mutex_init(&dispatcher->lock, NULL) != 0) {
+        return MEMORY_STATUS_NOK;
+    }
+    if (pthread_cond_init(&dispatcher->completed, NULL) != 0) {
+        pthread_mutex_destroy(&dispatcher->lock);
+        return MEMORY_STATUS_NOK;
+    }
+
+    // Queues must be in place before the first worker looks at them for stealing
+    size_t ready = 0;
+    for (; ready < dispatcher->bus_count; ready++) {
+        cat25256_bus_t *bus = &dispatcher->buses[ready];
+        bus->dispatcher = dispatcher;
+        bus->index = ready;
+        bus->head = NULL;
+        bus->tail = NULL;
+        bus->executed = 0;
+        bus->stolen = 0;
+        if (pthread_cond_init(&bus->wake, NULL) != 0) {
+            break;
+        }
+    }
+    if (ready != dispatcher->bus_count) {
+        while (ready > 0) {
+            pthread_cond_destroy(&dispatcher->buses[--ready].wake);
+        }
+        pthread_cond_destroy(&dispatcher->completed);
+        pthread_mutex_destroy(&dispatcher->lock);
+        return MEMORY_STATUS_NOK;
+    }
+
+    dispatcher->running = 1;
+    dispatcher->started = 0;
+    for (size_t i = 0; i < dispatcher->bus_count; i++) {
+        if (pthread_create(&dispatcher->buses[i].thread, NULL, cat25256_dispatch_worker, &dispatcher->buses[i]) !=
+            0) {
+            break;
+        }
+        dispatcher->started++;
+    }
+
+    if (dispatcher->started != dispatcher->bus_count) {
+        cat25256_dispatch_stop(dispatcher);
+        return MEMORY_STATUS_NOK;
+    }
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t cat25256_dispatch_stop(cat25256_dispatcher_t *dispatcher) {
+    if (dispatcher == NULL || dispatcher->buses == NULL) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    pthread_mutex_lock(&dispatcher->lock);
+    dispatcher->running = 0;
+    for (size_t i = 0; i < dispatcher->bus_count; i++) {
+        pthread_cond_signal(&dispatcher->buses[i].wake);
+    }
+    pthread_mutex_unlock(&dispatcher->lock);
+
+    memory_status_t rc = MEMORY_STATUS_OK;
+    for (size_t i = 0; i < dispatcher->started; i++) {
+        if (pthread_join(dispatcher->buses[i].thread, NULL) != 0) {
+            rc = MEMORY_STATUS_NOK;
+        }
+    }
+    for (size_t i = 0; i < dispatcher->bus_count; i++) {
+        pthread_cond_destroy(&dispatcher->buses[i].wake);
+    }
+    dispatcher->started = 0;
+    pthread_cond_destroy(&dispatcher->completed);
+    pthread_mutex_destroy(&dispatcher->lock);
+    return rc;
+}
+
+memory_status_t cat25256_dispatch_submit(cat25256_dispatcher_t *dispatcher, cat25256_job_t *job) {
+    if (dispatcher == NULL || job == NULL || job->location.bus >= dispatcher->bus_count) {
+        return MEMORY_STATUS_NOK;
+    }
+    if (job->type != CAT25256_JOB_READ && job->type != CAT25256_JOB_WRITE) {
+        return MEMORY_STATUS_NOK;
+    }
+    if ((job->data == NULL && job->length > 0) || (job->mirrors == NULL && job->mirror_count > 0)) {
+        return MEMORY_STATUS_NOK;
+    }
+    for (size_t m = 0; m < job->mirror_count; m++) {
+        if (job->mirrors[m].bus >= dispatcher->bus_count) {
+            return MEMORY_STATUS_NOK;
+        }
+    }
+
+    job->status = MEMORY_STATUS_OK;
+    job->next_offset = 0;
+    job->in_flight = 0;
+    job->next = NULL;
+    job->done = 0;
+
+    pthread_mutex_lock(&dispatcher->lock);
+    if (!dispatcher->running) {
+        pthread_mutex_unlock(&dispatcher->lock);
+        return MEMORY_STATUS_NOK;
+    }
+    if (job->length == 0) {
+        job->done = 1;
+        pthread_mutex_unlock(&dispatcher->lock);
+        return MEMORY_STATUS_OK;
+    }
+
+    cat25256_bus_t *bus = &dispatcher->buses[job->location.bus];
+    if (bus->tail == NULL) {
+        bus->head = job;
+    } else {
+        bus->tail->next = job;
+    }
+    bus->tail = job;
+
+    pthread_cond_signal(&bus->wake);
+    if (cat25256_dispatch_splittable(job)) {
+        // Idle mirror buses can start stealing right away
+        for (size_t m = 0; m < job->mirror_count; m++) {
+            pthread_cond_signal(&dispatcher->buses[job->mirrors[m].bus].wake);
+        }
+    }
+    pthread_mutex_unlock(&dispatcher->lock);
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t cat25256_dispatch_wait(cat25256_dispatcher_t *dispatcher, cat25256_job_t *job) {
+    if (dispatcher == NULL || job == NULL) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    pthread_mutex_lock(&dispatcher->lock);
+    while (!job->done) {
+        pthread_cond_wait(&dispatcher->completed, &dispatcher->lock);
+    }
+    memory_status_t rc = job->status;
+    pthread_mutex_unlock(&dispatcher->lock);
+    return rc;
+}
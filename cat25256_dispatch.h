@@ -0,0 +1,130 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAT25256_DISPATCH_H
+#define _CAT25256_DISPATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "cat25256.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    CAT25256_JOB_READ = 0,
+    CAT25256_JOB_WRITE
+} cat25256_job_type_t;
+
+/**
+ * A part on one of the buses of a dispatcher
+ */
+typedef struct {
+    size_t bus;
+    size_t cs;
+} cat25256_location_t;
+
+/**
+ * A read or write owned by the caller
+ * Reads may list mirrors, parts on other buses holding the same data. Such a read is split into stripe_size
+ * pieces which workers of the mirror buses steal while they are idle. status and done are valid after
+ * cat25256_dispatch_wait. The remaining members are maintained by the dispatcher.
+ */
+typedef struct cat25256_job {
+    cat25256_job_type_t type;
+    cat25256_location_t location;
+    uint32_t address;
+    uint8_t *data;
+    uint32_t length;
+    const cat25256_location_t *mirrors;
+    size_t mirror_count;
+    uint32_t stripe_size;
+
+    memory_status_t status;
+    uint8_t done;
+    uint32_t next_offset;
+    uint32_t in_flight;
+    struct cat25256_job *next;
+} cat25256_job_t;
+
+/**
+ * A bus with its own worker thread, handle serves every chip select on the bus
+ */
+typedef struct cat25256_dispatcher cat25256_dispatcher_t;
+
+typedef struct {
+    cat25256_handle_t *handle;
+
+    cat25256_dispatcher_t *dispatcher;
+    size_t index;
+    pthread_t thread;
+    pthread_cond_t wake;
+    cat25256_job_t *head;
+    cat25256_job_t *tail;
+    uint32_t executed;
+    uint32_t stolen;
+} cat25256_bus_t;
+
+/**
+ * Routes jobs by (bus, cs) to one worker per bus
+ */
+struct cat25256_dispatcher {
+    cat25256_bus_t *buses;
+    size_t bus_count;
+
+    pthread_mutex_t lock;
+    pthread_cond_t completed;
+    uint8_t running;
+    size_t started;
+};
+
+/**
+ * @brief Starts one worker per bus.
+ * @param dispatcher The dispatcher with buses and bus_count configured
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_dispatch_start(cat25256_dispatcher_t *dispatcher);
+
+/**
+ * @brief Lets the workers finish all queued jobs and joins them.
+ * @param dispatcher The dispatcher
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_dispatch_stop(cat25256_dispatcher_t *dispatcher);
+
+/**
+ * @brief Queues a job on the worker of its bus.
+ * @param dispatcher The dispatcher
+ * @param job The job, must stay valid until it is done
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_dispatch_submit(cat25256_dispatcher_t *dispatcher, cat25256_job_t *job);
+
+/**
+ * @brief Blocks until a job is done.
+ * @param dispatcher The dispatcher
+ * @param job The job
+ * @return The status of the job
+ */
+memory_status_t cat25256_dispatch_wait(cat25256_dispatcher_t *dispatcher, cat25256_job_t *job);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_CAT25256_DISPATCH_H
@@ -0,0 +1,252 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "cat25256_heap.h"
+#include "cat25256_crc.h"
+
+#define GRANULES_PER_PAGE (CAT25256_PAGE_SIZE / CAT25256_HEAP_GRANULE)
+
+static void cat25256_heap_put16(uint8_t *data, uint16_t value) {
+    data[0] = value;
+    data[1] = value >> 8;
+}
+
+static uint16_t cat25256_heap_get16(const uint8_t *data) {
+    return (uint16_t) (data[0] | data[1] << 8);
+}
+
+static uint8_t cat25256_heap_is_used(const cat25256_heap_t *heap, uint32_t granule) {
+    return (heap->free_map[granule / 8] >> (granule % 8)) & 1;
+}
+
+static void cat25256_heap_mark(cat25256_heap_t *heap, const cat25256_heap_entry_t *entry, uint8_t used) {
+    for (uint32_t i = entry->granule; i < (uint32_t) entry->granule + entry->granules; ++i) {
+        if (used) {
+            heap->free_map[i / 8] |= 1 << (i % 8);
+        } else {
+            heap->free_map[i / 8] &= ~(1 << (i % 8));
+        }
+    }
+}
+
+static void cat25256_heap_encode(const cat25256_heap_entry_t *entry, uint8_t *data) {
+    cat25256_heap_put16(&data[0], entry->tag);
+    cat25256_heap_put16(&data[2], entry->granule);
+    cat25256_heap_put16(&data[4], entry->granules);
+    cat25256_heap_put16(&data[6], cat25256_crc16(CAT25256_CRC16_INIT, data, 6));
+}
+
+static memory_status_t cat25256_heap_store(cat25256_heap_t *heap, size_t slot) {
+    uint8_t data[CAT25256_HEAP_ENTRY_SIZE];
+    cat25256_heap_encode(&heap->entries[slot], data);
+    uint32_t address = heap->table_address + CAT25256_HEAP_HEADER_SIZE + slot * CAT25256_HEAP_ENTRY_SIZE;
+    return cat25256_write(heap->handle, address, data, sizeof data, heap->cs);
+}
+
+static memory_status_t cat25256_heap_format(cat25256_heap_t *heap, uint8_t *table) {
+    memset(table, 0, CAT25256_HEAP_TABLE_SIZE);
+    cat25256_heap_put16(&table[0], CAT25256_HEAP_MAGIC);
+    cat25256_heap_put16(&table[2], CAT25256_HEAP_GRANULE);
+    cat25256_heap_put16(&table[4], CAT25256_HEAP_MAX_ENTRIES);
+    cat25256_heap_put16(&table[6], cat25256_crc16(CAT25256_CRC16_INIT, table, 6));
+    return cat25256_write(heap->handle, heap->table_address, table, CAT25256_HEAP_TABLE_SIZE, heap->cs);
+}
+
+static int cat25256_heap_slot(const cat25256_heap_t *heap, uint16_t tag) {
+    for (size_t i = 0; i < CAT25256_HEAP_MAX_ENTRIES; ++i) {
+        if (heap->entries[i].granules != 0 && heap->entries[i].tag == tag) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+memory_status_t cat25256_heap_mount(cat25256_heap_t *heap) {
+    if (heap == NULL || heap->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+    uint32_t capacity = heap->handle->capacity != 0 ? heap->handle->capacity : CAT25256_CAPACITY;
+    if (heap->start >= heap->end || heap->end > capacity ||
+        heap->start % CAT25256_HEAP_GRANULE != 0 || heap->end % CAT25256_HEAP_GRANULE != 0) {
+        return MEMORY_STATUS_NOK;
+    }
+    // The table must not be handed out as an allocation
+    if (heap->table_address + CAT25256_HEAP_TABLE_SIZE > capacity ||
+        (heap->table_address < heap->end && heap->table_address + CAT25256_HEAP_TABLE_SIZE > heap->start)) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    uint8_t table[CAT25256_HEAP_TABLE_SIZE];
+    memory_status_t rc = cat25256_read(heap->handle, heap->table_address, table, sizeof table, heap->cs);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
+    memset(heap->entries, 0, sizeof heap->entries);
+    memset(heap->free_map, 0, sizeof heap->free_map);
+
+    if (cat25256_heap_get16(&table[0]) != CAT25256_HEAP_MAGIC ||
+        cat25256_heap_get16(&table[2]) != CAT25256_HEAP_GRANULE ||
+        cat25256_heap_get16(&table[4]) != CAT25256_HEAP_MAX_ENTRIES ||
+        cat25256_heap_get16(&table[6]) != cat25256_crc16(CAT25256_CRC16_INIT, table, 6)) {
+        return cat25256_heap_format(heap, table);
+    }
+
+    for (size_t i = 0; i < CAT25256_HEAP_MAX_ENTRIES; ++i) {
+        const uint8_t *data = &table[CAT25256_HEAP_HEADER_SIZE + i * CAT25256_HEAP_ENTRY_SIZE];
+        if (cat25256_heap_get16(&data[6]) != cat25256_crc16(CAT25256_CRC16_INIT, data, 6)) {
+            continue;
+        }
+
+        cat25256_heap_entry_t entry = {
+                .tag = cat25256_heap_get16(&data[0]),
+                .granule = cat25256_heap_get16(&data[2]),
+                .granules = cat25256_heap_get16(&data[4]),
+        };
+        uint32_t first = entry.granule * CAT25256_HEAP_GRANULE;
+        uint32_t last = first + entry.granules * CAT25256_HEAP_GRANULE;
+        if (entry.tag == 0 || entry.granules == 0 || first < heap->start || last > heap->end) {
+            continue;
+        }
+
+        // Intact entries claiming the same tag or the same bytes are a corrupt table, not a torn write
+        uint8_t conflict = cat25256_heap_slot(heap, entry.tag) >= 0;
+        for (uint32_t g = entry.granule; !conflict && g < (uint32_t) entry.granule + entry.granules; ++g) {
+            conflict = cat25256_heap_is_used(heap, g);
+        }
+        if (conflict) {
+            memset(heap->entries, 0, sizeof heap->entries);
+            memset(heap->free_map, 0xFF, sizeof heap->free_map);
+            return MEMORY_STATUS_NOK;
+        }
+
+        heap->entries[i] = entry;
+        cat25256_heap_mark(heap, &entry, 1);
+    }
+
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t cat25256_heap_find(const cat25256_heap_t *heap, uint16_t tag, uint32_t *address, uint32_t *size) {
+    if (heap == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+
+    int slot = cat25256_heap_slot(heap, tag);
+    if (slot < 0) {
+        return MEMORY_STATUS_NOK;
+    }
+    if (address != NULL) {
+        *address = heap->entries[slot].granule * CAT25256_HEAP_GRANULE;
+    }
+    if (size != NULL) {
+        *size = heap->entries[slot].granules * CAT25256_HEAP_GRANULE;
+    }
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t
+cat25256_heap_alloc(cat25256_heap_t *heap, uint16_t tag, uint32_t size, uint8_t flags, uint32_t *address) {
+    if (heap == NULL || heap->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+    if (tag == 0 || size == 0 || address == NULL) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    uint32_t granules = (size + CAT25256_HEAP_GRANULE - 1) / CAT25256_HEAP_GRANULE;
+
+    uint32_t existing;
+    uint32_t existing_size;
+    if (cat25256_heap_find(heap, tag, &existing, &existing_size) == MEMORY_STATUS_OK) {
+        if (existing_size < size) {
+            return MEMORY_STATUS_NOK;
+        }
+        *address = existing;
+        return MEMORY_STATUS_OK;
+    }
+
+    int slot = -1;
+    for (size_t i = 0; i < CAT25256_HEAP_MAX_ENTRIES && slot < 0; ++i) {
+        if (heap->entries[i].granules == 0) {
+            slot = (int) i;
+        }
+    }
+    if (slot < 0) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    // First fit on the RAM free map
+    uint32_t first = heap->start / CAT25256_HEAP_GRANULE;
+    uint32_t last = heap->end / CAT25256_HEAP_GRANULE;
+    uint32_t step = flags & CAT25256_HEAP_PAGE_ALIGNED ? GRANULES_PER_PAGE : 1;
+    if (first % step != 0) {
+        first += step - first % step;
+    }
+
+    for (uint32_t candidate = first; candidate + granules <= last; candidate += step) {
+        uint32_t run = 0;
+        while (run < granules && !cat25256_heap_is_used(heap, candidate + run)) {
+            run++;
+        }
+        if (run != granules) {
+            continue;
+        }
+
+        heap->entries[slot].tag = tag;
+        heap->entries[slot].granule = candidate;
+        heap->entries[slot].granules = granules;
+
+        memory_status_t rc = cat25256_heap_store(heap, slot);
+        if (rc != MEMORY_STATUS_OK) {
+            memset(&heap->entries[slot], 0, sizeof heap->entries[slot]);
+            return rc;
+        }
+
+        cat25256_heap_mark(heap, &heap->entries[slot], 1);
+        *address = candidate * CAT25256_HEAP_GRANULE;
+        return MEMORY_STATUS_OK;
+    }
+
+    return MEMORY_STATUS_NOK;
+}
+
+memory_status_t cat25256_heap_free(cat25256_heap_t *heap, uint16_t tag) {
+    if (heap == NULL || heap->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+
+    int slot = cat25256_heap_slot(heap, tag);
+    if (slot < 0) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    cat25256_heap_entry_t entry = heap->entries[slot];
+    memset(&heap->entries[slot], 0, sizeof heap->entries[slot]);
+
+    // An all-zero entry fails its CRC and reads back as free
+    uint8_t data[CAT25256_HEAP_ENTRY_SIZE] = {0};
+    uint32_t address = heap->table_address + CAT25256_HEAP_HEADER_SIZE + slot * CAT25256_HEAP_ENTRY_SIZE;
+    memory_status_t rc = cat25256_write(heap->handle, address, data, sizeof data, heap->cs);
+    if (rc != MEMORY_STATUS_OK) {
+        heap->entries[slot] = entry;
+        return rc;
+    }
+
+    cat25256_heap_mark(heap, &entry, 0);
+    return MEMORY_STATUS_OK;
+}
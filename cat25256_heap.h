@@ -0,0 +1,116 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAT25256_HEAP_H
+#define _CAT25256_HEAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cat25256.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Allocation granularity and the number of allocations the metadata table can hold
+ */
+#ifndef CAT25256_HEAP_GRANULE
+#define CAT25256_HEAP_GRANULE 16
+#endif
+
+#ifndef CAT25256_HEAP_MAX_ENTRIES
+#define CAT25256_HEAP_MAX_ENTRIES 32
+#endif
+
+#define CAT25256_HEAP_MAGIC        0xC5A1
+#define CAT25256_HEAP_HEADER_SIZE  8
+#define CAT25256_HEAP_ENTRY_SIZE   8
+#define CAT25256_HEAP_TABLE_SIZE   (CAT25256_HEAP_HEADER_SIZE + CAT25256_HEAP_MAX_ENTRIES * CAT25256_HEAP_ENTRY_SIZE)
+
+/**
+ * Allocation flags
+ */
+#define CAT25256_HEAP_PAGE_ALIGNED 0x01
+
+/**
+ * A single allocation, granules == 0 marks a free slot
+ */
+typedef struct {
+    uint16_t tag;
+    uint16_t granule;
+    uint16_t granules;
+} cat25256_heap_entry_t;
+
+/**
+ * A persistent heap, all state needed at runtime is kept in RAM
+ * The table lives at table_address, allocations are carved out of [start, end).
+ */
+typedef struct {
+    cat25256_handle_t *handle;
+    size_t cs;
+    uint32_t table_address;
+    uint32_t start;
+    uint32_t end;
+    cat25256_heap_entry_t entries[CAT25256_HEAP_MAX_ENTRIES];
+    uint8_t free_map[CAT25256_CAPACITY / CAT25256_HEAP_GRANULE / 8];
+} cat25256_heap_t;
+
+/**
+ * @brief Reads the metadata table with one burst read and rebuilds the free map, formats a blank table.
+ * @param heap The heap, handle, cs, table_address, start and end must be set, the table must lie outside
+ * [start, end) and both within the capacity of the handle
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure, an invalid layout or a table whose
+ * entries share a tag or overlap
+ */
+memory_status_t cat25256_heap_mount(cat25256_heap_t *heap);
+
+/**
+ * @brief Allocates a region for tag. If tag is already allocated, the existing region is returned,
+ * so a module gets the same address after every reboot.
+ * @param heap The mounted heap
+ * @param tag A caller chosen, unique id of the allocation, 0 is reserved
+ * @param size The size in bytes
+ * @param flags 0 or CAT25256_HEAP_PAGE_ALIGNED
+ * @param address The address of the allocation
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK if there is no room or tag exists with a smaller size
+ */
+memory_status_t
+cat25256_heap_alloc(cat25256_heap_t *heap, uint16_t tag, uint32_t size, uint8_t flags, uint32_t *address);
+
+/**
+ * @brief Looks up an existing allocation without touching the bus.
+ * @param heap The mounted heap
+ * @param tag The id of the allocation
+ * @param address The address of the allocation
+ * @param size The usable size of the allocation
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK if tag is not allocated
+ */
+memory_status_t cat25256_heap_find(const cat25256_heap_t *heap, uint16_t tag, uint32_t *address, uint32_t *size);
+
+/**
+ * @brief Releases an allocation.
+ * @param heap The mounted heap
+ * @param tag The id of the allocation
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK if tag is not allocated
+ */
+memory_status_t cat25256_heap_free(cat25256_heap_t *heap, uint16_t tag);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_CAT25256_HEAP_H
@@ -0,0 +1,269 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "cat25256_limit.h"
+
+#define PAGE_SIZE CAT25256_PAGE_SIZE
+
+static void cat25256_limit_refill(cat25256_limit_region_t *region, uint32_t now_ms) {
+    uint32_t elapsed = now_ms - region->last_refill_ms;
+    uint32_t earned = elapsed / region->interval_ms;
+    if (earned == 0) {
+        return;
+    }
+
+    region->last_refill_ms += earned * region->interval_ms;
+    region->tokens = region->tokens + earned > region->burst ? region->burst : region->tokens + earned;
+}
+
+static void cat25256_limit_track(cat25256_limit_region_t *region, uint32_t now_ms) {
+    // Steps of the 32 bit clock add up in 64 bits, the lifetime projection outlives its wrap
+    region->elapsed_ms += now_ms - region->seen_ms;
+    region->seen_ms = now_ms;
+}
+
+static memory_status_t cat25256_limit_program(cat25256_limiter_t *limiter, cat25256_limit_region_t *region) {
+    uint32_t first = region->dirty_first;
+    uint32_t last = region->dirty_last;
+
+    memory_status_t rc = cat25256_write(limiter->handle, region->address + first, &region->staging[first],
+                                        last - first, limiter->cs);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
+    if (region->page_programs != NULL) {
+        uint32_t base_page = region->address / PAGE_SIZE;
+        for (uint32_t page = (region->address + first) / PAGE_SIZE;
+             page <= (region->address + last - 1) / PAGE_SIZE; ++page) {
+            region->page_programs[page - base_page]++;
+        }
+    }
+
+    region->dirty_first = region->length;
+    region->dirty_last = 0;
+    region->flushes++;
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t cat25256_limit_init(cat25256_limiter_t *limiter, uint32_t now_ms) {
+    if (limiter == NULL || limiter->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+
+    for (size_t i = 0; i < limiter->region_count; ++i) {
+        cat25256_limit_region_t *region = &limiter->regions[i];
+        if (region->staging == NULL || region->length == 0 || region->burst == 0) {
+            return MEMORY_STATUS_NOK;
+        }
+
+        // Every page of the region may be programmed once per interval over the target lifetime
+        uint64_t interval = (uint64_t) region->lifetime_s * 1000 / CAT25256_ENDURANCE_CYCLES;
+        region->interval_ms = interval > 0 ? (uint32_t) interval : 1;
+        region->tokens = region->burst;
+        region->last_refill_ms = now_ms;
+        region->seen_ms = now_ms;
+        region->elapsed_ms = 0;
+        region->dirty_first = region->length;
+        region->dirty_last = 0;
+
+        memory_status_t rc = cat25256_read(limiter->handle, region->address, region->staging, region->length,
+                                           limiter->cs);
+        if (rc != MEMORY_STATUS_OK) {
+            return rc;
+        }
+    }
+    return MEMORY_STATUS_OK;
+}
+
+/**
+ * Returns the region holding address, or NULL if none does. end is clipped to the end of that region, or to
+ * the start of the next region for an address outside all regions.
+ */
+static cat25256_limit_region_t *cat25256_limit_find(cat25256_limiter_t *limiter, uint32_t address, uint32_t *end) {
+    cat25256_limit_region_t *found = NULL;
+    for (size_t i = 0; i < limiter->region_count; ++i) {
+        cat25256_limit_region_t *region = &limiter->regions[i];
+        if (address >= region->address && address < region->address + region->length) {
+            found = region;
+            if (*end > region->address + region->length) {
+                *end = region->address + region->length;
+            }
+        } else if (region->address > address && region->address < *end) {
+            *end = region->address;
+        }
+    }
+    return found;
+}
+
+static memory_status_t
+cat25256_limit_stage(cat25256_limiter_t *limiter, cat25256_limit_region_t *region, uint32_t address,
+                     const uint8_t *data, uint32_t length, uint32_t now_ms) {
+    uint32_t first = address - region->address;
+    uint32_t last = first + length;
+    if (region->dirty_first < region->dirty_last) {
+        region->coalesced++;
+    }
+    memcpy(&region->staging[first], data, length);
+    region->dirty_first = first < region->dirty_first ? first : region->dirty_first;
+    region->dirty_last = last > region->dirty_last ? last : region->dirty_last;
+    region->writes++;
+
+    cat25256_limit_track(region, now_ms);
+    cat25256_limit_refill(region, now_ms);
+    if (region->tokens == 0) {
+        return MEMORY_STATUS_OK;
+    }
+
+    region->tokens--;
+    return cat25256_limit_program(limiter, region);
+}
+
+memory_status_t
+cat25256_limit_write(cat25256_limiter_t *limiter, uint32_t address, const uint8_t *data, uint32_t length,
+                     uint32_t now_ms) {
+    if (limiter == NULL || limiter->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+
+    // Split at region borders, every part that falls into a region goes through its staging buffer
+    uint32_t end = address + length;
+    while (address < end) {
+        uint32_t part_end = end;
+        cat25256_limit_region_t *region = cat25256_limit_find(limiter, address, &part_end);
+        memory_status_t rc;
+        if (region == NULL) {
+            rc = cat25256_write(limiter->handle, address, data, part_end - address, limiter->cs);
+        } else {
+            rc = cat25256_limit_stage(limiter, region, address, data, part_end - address, now_ms);
+        }
+        if (rc != MEMORY_STATUS_OK) {
+            return rc;
+        }
+        data += part_end - address;
+        address = part_end;
+    }
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t cat25256_limit_read(cat25256_limiter_t *limiter, uint32_t address, uint8_t *data, uint32_t length) {
+    if (limiter == NULL || limiter->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+
+    memory_status_t rc = cat25256_read(limiter->handle, address, data, length, limiter->cs);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
+    // Overlay data that is still waiting for budget
+    for (size_t i = 0; i < limiter->region_count; ++i) {
+        const cat25256_limit_region_t *region = &limiter->regions[i];
+        if (region->dirty_first >= region->dirty_last) {
+            continue;
+        }
+        uint32_t pending_first = region->address + region->dirty_first;
+        uint32_t pending_last = region->address + region->dirty_last;
+        uint32_t first = address > pending_first ? address : pending_first;
+        uint32_t last = address + length < pending_last ? address + length : pending_last;
+        if (first < last) {
+            memcpy(&data[first - address], &region->staging[first - region->address], last - first);
+        }
+    }
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t cat25256_limit_poll(cat25256_limiter_t *limiter, uint32_t now_ms) {
+    if (limiter == NULL || limiter->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+
+    for (size_t i = 0; i < limiter->region_count; ++i) {
+        cat25256_limit_region_t *region = &limiter->regions[i];
+        cat25256_limit_track(region, now_ms);
+        if (region->dirty_first >= region->dirty_last) {
+            continue;
+        }
+
+        cat25256_limit_refill(region, now_ms);
+        if (region->tokens == 0) {
+            continue;
+        }
+
+        region->tokens--;
+        memory_status_t rc = cat25256_limit_program(limiter, region);
+        if (rc != MEMORY_STATUS_OK) {
+            return rc;
+        }
+    }
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t cat25256_limit_flush(cat25256_limiter_t *limiter) {
+    if (limiter == NULL || limiter->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+
+    for (size_t i = 0; i < limiter->region_count; ++i) {
+        cat25256_limit_region_t *region = &limiter->regions[i];
+        if (region->dirty_first >= region->dirty_last) {
+            continue;
+        }
+
+        memory_status_t rc = cat25256_limit_program(limiter, region);
+        if (rc != MEMORY_STATUS_OK) {
+            return rc;
+        }
+    }
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t
+cat25256_limit_stats(const cat25256_limiter_t *limiter, size_t region, uint32_t now_ms, cat25256_limit_stats_t *stats) {
+    if (limiter == NULL || stats == NULL || region >= limiter->region_count) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    const cat25256_limit_region_t *limited = &limiter->regions[region];
+    stats->writes = limited->writes;
+    stats->coalesced = limited->coalesced;
+    stats->flushes = limited->flushes;
+
+    // Without per-page counters every flush is assumed to hit the same page
+    uint32_t max_programs = limited->flushes;
+    if (limited->page_programs != NULL) {
+        max_programs = 0;
+        uint32_t pages = (limited->address + limited->length - 1) / PAGE_SIZE - limited->address / PAGE_SIZE + 1;
+        for (uint32_t page = 0; page < pages; ++page) {
+            if (limited->page_programs[page] > max_programs) {
+                max_programs = limited->page_programs[page];
+            }
+        }
+    }
+    stats->max_page_programs = max_programs;
+    stats->consumed_ppm = (uint32_t) ((uint64_t) max_programs * 1000000 / CAT25256_ENDURANCE_CYCLES);
+
+    // Extrapolate the observed program rate of the most worn page to the endurance limit
+    uint64_t elapsed_ms = limited->elapsed_ms + (uint32_t) (now_ms - limited->seen_ms);
+    if (max_programs == 0) {
+        stats->projected_lifetime_s = UINT32_MAX;
+    } else {
+        uint64_t lifetime = elapsed_ms * CAT25256_ENDURANCE_CYCLES / max_programs / 1000;
+        stats->projected_lifetime_s = lifetime > UINT32_MAX ? UINT32_MAX : (uint32_t) lifetime;
+    }
+    return MEMORY_STATUS_OK;
+}
@@ -0,0 +1,142 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAT25256_LIMIT_H
+#define _CAT25256_LIMIT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cat25256.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A rate limited region
+ * Configure address, length, lifetime_s, burst and staging (length bytes), page_programs is optional and
+ * holds one counter per page touched by the region. The remaining members are maintained by the limiter.
+ */
+typedef struct {
+    uint32_t address;
+    uint32_t length;
+    uint32_t lifetime_s;
+    uint16_t burst;
+    uint8_t *staging;
+    uint32_t *page_programs;
+
+    uint32_t interval_ms;
+    uint32_t tokens;
+    uint32_t last_refill_ms;
+    uint32_t seen_ms;
+    uint64_t elapsed_ms;
+    uint32_t dirty_first;
+    uint32_t dirty_last;
+    uint32_t writes;
+    uint32_t coalesced;
+    uint32_t flushes;
+} cat25256_limit_region_t;
+
+/**
+ * Write budget enforcer for a set of regions of one chip
+ */
+typedef struct {
+    cat25256_handle_t *handle;
+    size_t cs;
+    cat25256_limit_region_t *regions;
+    size_t region_count;
+} cat25256_limiter_t;
+
+/**
+ * Endurance statistics of a region
+ */
+typedef struct {
+    uint32_t writes;
+    uint32_t coalesced;
+    uint32_t flushes;
+    uint32_t max_page_programs;
+    uint32_t consumed_ppm;
+    uint32_t projected_lifetime_s;
+} cat25256_limit_stats_t;
+
+/**
+ * @brief Loads the staging buffers of all regions and fills their token buckets.
+ * @param limiter The limiter
+ * @param now_ms The current time in milliseconds
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_limit_init(cat25256_limiter_t *limiter, uint32_t now_ms);
+
+/**
+ * @brief Writes through the limiter. Writes into a region without budget left are coalesced into its
+ * staging buffer and programmed by a later cat25256_limit_poll, writes outside all regions pass through.
+ * A write spanning several regions is split at their borders and every part is charged to its own region.
+ * The parts are handled in address order and independently: parts whose region has budget are programmed
+ * at once, parts whose region is exhausted stay staged, also when an earlier part was already programmed.
+ * Reads through cat25256_limit_read see the staged parts, the device sees them after a later poll.
+ * @param limiter The limiter
+ * @param address The address to write to
+ * @param data The data buffer to write
+ * @param length The length of the data buffer, may span several regions and the gaps between them
+ * @param now_ms The current time in milliseconds
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t
+cat25256_limit_write(cat25256_limiter_t *limiter, uint32_t address, const uint8_t *data, uint32_t length,
+                     uint32_t now_ms);
+
+/**
+ * @brief Reads through the limiter, coalesced data not yet programmed is served from the staging buffers.
+ * @param limiter The limiter
+ * @param address The address to read from
+ * @param data The data buffer to read into
+ * @param length The length of the data buffer
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_limit_read(cat25256_limiter_t *limiter, uint32_t address, uint8_t *data, uint32_t length);
+
+/**
+ * @brief Programs coalesced writes of all regions that have budget again, call it periodically and at least
+ * once per wrap of the millisecond clock (about 49 days).
+ * @param limiter The limiter
+ * @param now_ms The current time in milliseconds
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_limit_poll(cat25256_limiter_t *limiter, uint32_t now_ms);
+
+/**
+ * @brief Programs all coalesced writes regardless of the budget, e.g. before power down.
+ * @param limiter The limiter
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_limit_flush(cat25256_limiter_t *limiter);
+
+/**
+ * @brief Reports the endurance consumption of a region.
+ * @param limiter The limiter
+ * @param region The index of the region
+ * @param now_ms The current time in milliseconds
+ * @param stats The statistics
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t
+cat25256_limit_stats(const cat25256_limiter_t *limiter, size_t region, uint32_t now_ms, cat25256_limit_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_CAT25256_LIMIT_H
@@ -0,0 +1,142 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "cat25256_pack.h"
+
+#define PAGE_SIZE CAT25256_PAGE_SIZE
+
+static uint32_t cat25256_pack_fill(const cat25256_pack_t *pack, uint32_t page) {
+    uint32_t fill = 0;
+    for (size_t i = 0; i < pack->record_count; ++i) {
+        if (pack->offsets[i] != CAT25256_PACK_UNPLACED && pack->offsets[i] / PAGE_SIZE == page) {
+            fill += pack->records[i].size;
+        }
+    }
+    return fill;
+}
+
+memory_status_t cat25256_pack_layout(cat25256_pack_t *pack) {
+    if (pack == NULL || pack->records == NULL || pack->offsets == NULL) {
+        return MEMORY_STATUS_NOK;
+    }
+    if (pack->address % PAGE_SIZE != 0) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    for (size_t i = 0; i < pack->record_count; ++i) {
+        if (pack->records[i].size == 0 || pack->records[i].size > PAGE_SIZE) {
+            return MEMORY_STATUS_NOK;
+        }
+        pack->offsets[i] = CAT25256_PACK_UNPLACED;
+    }
+
+    // Groups get disjoint page ranges, records are placed first-fit within the pages of their group
+    uint32_t next_page = 0;
+    for (uint32_t group = 0; group <= UINT8_MAX; ++group) {
+        uint32_t first_page = next_page;
+        for (size_t i = 0; i < pack->record_count; ++i) {
+            if (pack->records[i].group != group) {
+                continue;
+            }
+
+            uint32_t page = first_page;
+            while (page < next_page && cat25256_pack_fill(pack, page) + pack->records[i].size > PAGE_SIZE) {
+                page++;
+            }
+            if (page == next_page) {
+                if (next_page >= pack->pages) {
+                    return MEMORY_STATUS_NOK;
+                }
+                next_page++;
+            }
+            pack->offsets[i] = page * PAGE_SIZE + cat25256_pack_fill(pack, page);
+        }
+    }
+
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t cat25256_pack_load(cat25256_pack_t *pack) {
+    if (pack == NULL || pack->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+    if (pack->shadow == NULL || pack->dirty == NULL) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    memset(pack->dirty, 0, (pack->pages + 7) / 8);
+    return cat25256_read(pack->handle, pack->address, pack->shadow, pack->pages * PAGE_SIZE, pack->cs);
+}
+
+memory_status_t cat25256_pack_get(const cat25256_pack_t *pack, size_t record, void *data) {
+    if (pack == NULL || data == NULL || record >= pack->record_count) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    memcpy(data, &pack->shadow[pack->offsets[record]], pack->records[record].size);
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t cat25256_pack_set(cat25256_pack_t *pack, size_t record, const void *data) {
+    if (pack == NULL || data == NULL || record >= pack->record_count) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    uint8_t *target = &pack->shadow[pack->offsets[record]];
+    if (memcmp(target, data, pack->records[record].size) == 0) {
+        return MEMORY_STATUS_OK;
+    }
+
+    memcpy(target, data, pack->records[record].size);
+    uint32_t page = pack->offsets[record] / PAGE_SIZE;
+    pack->dirty[page / 8] |= 1 << (page % 8);
+    pack->stats.record_writes++;
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t cat25256_pack_commit(cat25256_pack_t *pack) {
+    if (pack == NULL || pack->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+
+    for (uint32_t page = 0; page < pack->pages; ++page) {
+        if (!(pack->dirty[page / 8] & (1 << (page % 8)))) {
+            continue;
+        }
+
+        uint32_t fill = cat25256_pack_fill(pack, page);
+        memory_status_t rc = cat25256_write_page(pack->handle, pack->address + page * PAGE_SIZE,
+                                                 &pack->shadow[page * PAGE_SIZE], fill, pack->cs);
+        if (rc != MEMORY_STATUS_OK) {
+            return rc;
+        }
+
+        pack->dirty[page / 8] &= ~(1 << (page % 8));
+        pack->stats.page_programs++;
+    }
+
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t cat25256_pack_stats(const cat25256_pack_t *pack, cat25256_pack_stats_t *stats) {
+    if (pack == NULL || stats == NULL) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    *stats = pack->stats;
+    return MEMORY_STATUS_OK;
+}
@@ -0,0 +1,115 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAT25256_PACK_H
+#define _CAT25256_PACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cat25256.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAT25256_PACK_UNPLACED 0xFFFF
+
+/**
+ * A small record, records of the same group are updated together and share pages,
+ * records of different groups (e.g. hot and cold) never share a page.
+ */
+typedef struct {
+    uint16_t size;
+    uint8_t group;
+} cat25256_record_t;
+
+/**
+ * Page program accounting, record_writes is the number of programs the records would have cost unpacked
+ */
+typedef struct {
+    uint32_t record_writes;
+    uint32_t page_programs;
+} cat25256_pack_stats_t;
+
+/**
+ * A packed record region of pages * CAT25256_PAGE_SIZE bytes starting at the page aligned address.
+ * offsets holds record_count entries, shadow pages * CAT25256_PAGE_SIZE bytes, dirty (pages + 7) / 8 bytes.
+ */
+typedef struct {
+    cat25256_handle_t *handle;
+    size_t cs;
+    uint32_t address;
+    uint32_t pages;
+    const cat25256_record_t *records;
+    size_t record_count;
+    uint16_t *offsets;
+    uint8_t *shadow;
+    uint8_t *dirty;
+    cat25256_pack_stats_t stats;
+} cat25256_pack_t;
+
+/**
+ * @brief Assigns every record a place in the region. The layout only depends on the record table.
+ * @param pack The packed region
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK if the records do not fit
+ */
+memory_status_t cat25256_pack_layout(cat25256_pack_t *pack);
+
+/**
+ * @brief Loads the whole region into the shadow with a single burst read.
+ * @param pack The packed region
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_pack_load(cat25256_pack_t *pack);
+
+/**
+ * @brief Copies a record out of the shadow.
+ * @param pack The packed region
+ * @param record The record handle, its index in the record table
+ * @param data Buffer of the record size
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_pack_get(const cat25256_pack_t *pack, size_t record, void *data);
+
+/**
+ * @brief Updates a record in the shadow, its page is programmed on the next commit if the record changed.
+ * @param pack The packed region
+ * @param record The record handle, its index in the record table
+ * @param data The new contents of the record size
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_pack_set(cat25256_pack_t *pack, size_t record, const void *data);
+
+/**
+ * @brief Programs every page with changed records once.
+ * @param pack The packed region
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_pack_commit(cat25256_pack_t *pack);
+
+/**
+ * @brief Reports the page programs saved by packing.
+ * @param pack The packed region
+ * @param stats The statistics
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_pack_stats(const cat25256_pack_t *pack, cat25256_pack_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_CAT25256_PACK_H
@@ -0,0 +1,468 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "cat25256_partition.h"
+#include "cat25256_crc.h"
+
+#define PAGE_SIZE        CAT25256_PAGE_SIZE
+#define LOG_HEADER_SIZE  4
+
+/**
+ * Table: magic u16, count u8, reserved u8, crc u16 over the entries, entries: id u8, policy u8, start u16, size u16
+ * Log records: length u16, inverted length u16, data
+ */
+
+static void cat25256_partition_put16(uint8_t *data, uint16_t value) {
+    data[0] = value;
+    data[1] = value >> 8;
+}
+
+static uint16_t cat25256_partition_get16(const uint8_t *data) {
+    return (uint16_t) (data[0] | data[1] << 8);
+}
+
+static cat25256_partition_t *cat25256_partition_find(cat25256_partition_table_t *table, uint8_t id) {
+    for (size_t i = 0; i < table->count; ++i) {
+        if (table->partitions[i].entry.id == id) {
+            return &table->partitions[i];
+        }
+    }
+    return NULL;
+}
+
+static memory_status_t
+cat25256_partition_validate(const cat25256_partition_table_t *table, const cat25256_partition_entry_t *entries,
+                            size_t count) {
+    uint32_t capacity = table->handle->capacity != 0 ? table->handle->capacity : CAT25256_CAPACITY;
+    uint32_t table_start = table->table_address;
+    uint32_t table_end = table_start + CAT25256_PARTITION_TABLE_SIZE;
+    if (table_end > capacity) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t start = entries[i].start;
+        uint32_t end = start + entries[i].size;
+        if (entries[i].size == 0 || start % PAGE_SIZE != 0 || entries[i].size % PAGE_SIZE != 0 ||
+            end > capacity || entries[i].policy > CAT25256_POLICY_READ_ONLY ||
+            (start < table_end && table_start < end)) {
+            return MEMORY_STATUS_NOK;
+        }
+        for (size_t j = 0; j < i; ++j) {
+            if (entries[j].id == entries[i].id ||
+                (start < (uint32_t) entries[j].start + entries[j].size && entries[j].start < end)) {
+                return MEMORY_STATUS_NOK;
+            }
+        }
+    }
+    return MEMORY_STATUS_OK;
+}
+
+static memory_status_t cat25256_partition_find_head(cat25256_partition_table_t *table, cat25256_partition_t *log) {
+    log->log_head = 0;
+    while (log->log_head + LOG_HEADER_SIZE <= log->entry.size) {
+        uint8_t header[LOG_HEADER_SIZE];
+        memory_status_t rc = cat25256_read(table->handle, log->entry.start + log->log_head, header, sizeof header,
+                                           table->cs);
+        if (rc != MEMORY_STATUS_OK) {
+            return rc;
+        }
+
+        uint16_t length = cat25256_partition_get16(&header[0]);
+        uint16_t check = cat25256_partition_get16(&header[2]) ^ 0xFFFF;
+        if (length != check ||
+            log->log_head + LOG_HEADER_SIZE + length > log->entry.size) {
+            break;
+        }
+        log->log_head += LOG_HEADER_SIZE + length;
+    }
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t
+cat25256_partition_format(cat25256_partition_table_t *table, const cat25256_partition_entry_t *entries, size_t count) {
+    if (table == NULL || table->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+    if ((entries == NULL && count > 0) || count > CAT25256_PARTITION_MAX ||
+        cat25256_partition_validate(table, entries, count) != MEMORY_STATUS_OK) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    uint8_t data[CAT25256_PARTITION_TABLE_SIZE] = {0};
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t *entry = &data[CAT25256_PARTITION_HEADER_SIZE + i * CAT25256_PARTITION_ENTRY_SIZE];
+        entry[0] = entries[i].id;
+        entry[1] = entries[i].policy;
+        cat25256_partition_put16(&entry[2], entries[i].start);
+        cat25256_partition_put16(&entry[4], entries[i].size);
+    }
+    cat25256_partition_put16(&data[0], CAT25256_PARTITION_MAGIC);
+    data[2] = (uint8_t) count;
+    cat25256_partition_put16(&data[4], cat25256_crc16(CAT25256_CRC16_INIT, &data[CAT25256_PARTITION_HEADER_SIZE],
+                                                      count * CAT25256_PARTITION_ENTRY_SIZE));
+
+    memory_status_t rc = cat25256_write(table->handle, table->table_address, data,
+                                        CAT25256_PARTITION_HEADER_SIZE + count * CAT25256_PARTITION_ENTRY_SIZE,
+                                        table->cs);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
+    // New logs start empty
+    table->count = count;
+    for (size_t i = 0; i < count; ++i) {
+        memset(&table->partitions[i], 0, sizeof table->partitions[i]);
+        table->partitions[i].entry = entries[i];
+        if (entries[i].policy == CAT25256_POLICY_LOG) {
+            rc = cat25256_partition_reset_log(table, entries[i].id);
+            if (rc != MEMORY_STATUS_OK) {
+                return rc;
+            }
+        }
+    }
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t cat25256_partition_mount(cat25256_partition_table_t *table) {
+    if (table == NULL || table->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+
+    table->count = 0;
+
+    uint8_t data[CAT25256_PARTITION_TABLE_SIZE];
+    memory_status_t rc = cat25256_read(table->handle, table->table_address, data, sizeof data, table->cs);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
+    size_t count = data[2];
+    if (cat25256_partition_get16(&data[0]) != CAT25256_PARTITION_MAGIC || count > CAT25256_PARTITION_MAX ||
+        cat25256_partition_get16(&data[4]) != cat25256_crc16(CAT25256_CRC16_INIT, &data[CAT25256_PARTITION_HEADER_SIZE],
+                                                             count * CAT25256_PARTITION_ENTRY_SIZE)) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    cat25256_partition_entry_t entries[CAT25256_PARTITION_MAX];
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t *entry = &data[CAT25256_PARTITION_HEADER_SIZE + i * CAT25256_PARTITION_ENTRY_SIZE];
+        entries[i].id = entry[0];
+        entries[i].policy = entry[1];
+        entries[i].start = cat25256_partition_get16(&entry[2]);
+        entries[i].size = cat25256_partition_get16(&entry[4]);
+    }
+    if (cat25256_partition_validate(table, entries, count) != MEMORY_STATUS_OK) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        memset(&table->partitions[i], 0, sizeof table->partitions[i]);
+        table->partitions[i].entry = entries[i];
+        if (entries[i].policy == CAT25256_POLICY_LOG) {
+            rc = cat25256_partition_find_head(table, &table->partitions[i]);
+            if (rc != MEMORY_STATUS_OK) {
+                return rc;
+            }
+        }
+    }
+    table->count = count;
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t
+cat25256_partition_attach_cache(cat25256_partition_table_t *table, uint8_t id, cat25256_cache_slot_t *slots,
+                                uint8_t count) {
+    if (table == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+
+    cat25256_partition_t *partition = cat25256_partition_find(table, id);
+    if (partition == NULL || partition->entry.policy != CAT25256_POLICY_WRITE_BACK || slots == NULL || count == 0) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    memset(slots, 0, count * sizeof slots[0]);
+    partition->cache = slots;
+    partition->cache_slots = count;
+    partition->next_victim = 0;
+    return MEMORY_STATUS_OK;
+}
+
+static memory_status_t
+cat25256_partition_lookup(cat25256_partition_table_t *table, uint8_t id, uint32_t offset, uint32_t length,
+                          cat25256_partition_t **partition) {
+    if (table == NULL || table->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+
+    *partition = cat25256_partition_find(table, id);
+    if (*partition == NULL) {
+        return MEMORY_STATUS_NOK;
+    }
+    if (offset > (*partition)->entry.size || length > (*partition)->entry.size - offset) {
+        return MEMORY_STATUS_OUT_OF_RANGE;
+    }
+    return MEMORY_STATUS_OK;
+}
+
+static memory_status_t
+cat25256_partition_write_slot(cat25256_partition_table_t *table, cat25256_cache_slot_t *slot) {
+    if (!slot->valid || !slot->dirty) {
+        return MEMORY_STATUS_OK;
+    }
+
+    memory_status_t rc = cat25256_write_page(table->handle, (uint32_t) slot->page * PAGE_SIZE, slot->data, PAGE_SIZE,
+                                             table->cs);
+    if (rc == MEMORY_STATUS_OK) {
+        slot->dirty = 0;
+    }
+    return rc;
+}
+
+static cat25256_cache_slot_t *cat25256_partition_cached(cat25256_partition_t *partition, uint32_t page) {
+    for (uint8_t i = 0; i < partition->cache_slots; ++i) {
+        if (partition->cache[i].valid && partition->cache[i].page == page) {
+            return &partition->cache[i];
+        }
+    }
+    return NULL;
+}
+
+static memory_status_t
+cat25256_partition_write_back(cat25256_partition_table_t *table, cat25256_partition_t *partition, uint32_t address,
+                              const uint8_t *data, uint32_t length) {
+    if (partition->cache == NULL) {
+        return cat25256_write(table->handle, address, data, length, table->cs);
+    }
+
+    while (length > 0) {
+        uint32_t page = address / PAGE_SIZE;
+        uint32_t offset = address % PAGE_SIZE;
+        uint32_t chunk = PAGE_SIZE - offset < length ? PAGE_SIZE - offset : length;
+
+        cat25256_cache_slot_t *slot = cat25256_partition_cached(partition, page);
+        if (slot == NULL) {
+            // Round robin eviction, the victim is programmed before it is reused
+            slot = &partition->cache[partition->next_victim];
+            partition->next_victim = (partition->next_victim + 1) % partition->cache_slots;
+
+            memory_status_t rc = cat25256_partition_write_slot(table, slot);
+            if (rc != MEMORY_STATUS_OK) {
+                return rc;
+            }
+            slot->valid = 0;
+            if (chunk < PAGE_SIZE) {
+                rc = cat25256_read(table->handle, page * PAGE_SIZE, slot->data, PAGE_SIZE, table->cs);
+                if (rc != MEMORY_STATUS_OK) {
+                    return rc;
+                }
+            }
+            slot->page = (uint16_t) page;
+            slot->valid = 1;
+            // An unread slot still holds stale bytes, comparing against them could drop the write
+            slot->dirty = chunk == PAGE_SIZE;
+        }
+
+        if (memcmp(&slot->data[offset], data, chunk) != 0) {
+            memcpy(&slot->data[offset], data, chunk);
+            slot->dirty = 1;
+        }
+
+        address += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+    return MEMORY_STATUS_OK;
+}
+
+static memory_status_t
+cat25256_partition_write_compare(cat25256_partition_table_t *table, uint32_t address, const uint8_t *data,
+                                 uint32_t length) {
+    while (length > 0) {
+        uint32_t chunk = PAGE_SIZE - address % PAGE_SIZE < length ? PAGE_SIZE - address % PAGE_SIZE : length;
+
+        // A read costs bus time only, a program costs tWC and endurance
+        uint8_t current[PAGE_SIZE];
+        memory_status_t rc = cat25256_read(table->handle, address, current, chunk, table->cs);
+        if (rc != MEMORY_STATUS_OK) {
+            return rc;
+        }
+
+        uint32_t first = 0;
+        while (first < chunk && current[first] == data[first]) {
+            first++;
+        }
+        if (first < chunk) {
+            uint32_t last = chunk;
+            while (current[last - 1] == data[last - 1]) {
+                last--;
+            }
+            rc = cat25256_write_page(table->handle, address + first, &data[first], last - first, table->cs);
+            if (rc != MEMORY_STATUS_OK) {
+                return rc;
+            }
+        }
+
+        address += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t
+cat25256_partition_read(cat25256_partition_table_t *table, uint8_t id, uint32_t offset, uint8_t *data,
+                        uint32_t length) {
+    cat25256_partition_t *partition;
+    memory_status_t rc = cat25256_partition_lookup(table, id, offset, length, &partition);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
+    uint32_t address = partition->entry.start + offset;
+    rc = cat25256_read(table->handle, address, data, length, table->cs);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
+    // Cached pages are newer than the device
+    for (uint8_t i = 0; i < partition->cache_slots; ++i) {
+        const cat25256_cache_slot_t *slot = &partition->cache[i];
+        if (!slot->valid) {
+            continue;
+        }
+        uint32_t page_start = (uint32_t) slot->page * PAGE_SIZE;
+        uint32_t first = address > page_start ? address : page_start;
+        uint32_t last = address + length < page_start + PAGE_SIZE ? address + length : page_start + PAGE_SIZE;
+        if (first < last) {
+            memcpy(&data[first - address], &slot->data[first - page_start], last - first);
+        }
+    }
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t
+cat25256_partition_write(cat25256_partition_table_t *table, uint8_t id, uint32_t offset, const uint8_t *data,
+                         uint32_t length) {
+    cat25256_partition_t *partition;
+    memory_status_t rc = cat25256_partition_lookup(table, id, offset, length, &partition);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
+    uint32_t address = partition->entry.start + offset;
+    switch (partition->entry.policy) {
+        case CAT25256_POLICY_WRITE_THROUGH:
+            return cat25256_write(table->handle, address, data, length, table->cs);
+        case CAT25256_POLICY_WRITE_BACK:
+            return cat25256_partition_write_back(table, partition, address, data, length);
+        case CAT25256_POLICY_COMPARE:
+            return cat25256_partition_write_compare(table, address, data, length);
+        case CAT25256_POLICY_READ_ONLY:
+            return MEMORY_STATUS_PROTECTED;
+        default:
+            return MEMORY_STATUS_NOK;
+    }
+}
+
+memory_status_t
+cat25256_partition_append(cat25256_partition_table_t *table, uint8_t id, const uint8_t *data, uint16_t length,
+                          uint32_t *offset) {
+    if (table == NULL || table->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+
+    cat25256_partition_t *partition = cat25256_partition_find(table, id);
+    if (partition == NULL || partition->entry.policy != CAT25256_POLICY_LOG || (data == NULL && length > 0) ||
+        partition->log_head + LOG_HEADER_SIZE + length > partition->entry.size) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    uint32_t address = partition->entry.start + partition->log_head;
+
+    // Data and the terminator behind it first, the header makes the record visible
+    uint32_t next = partition->log_head + LOG_HEADER_SIZE + length;
+    uint32_t terminator = next + LOG_HEADER_SIZE <= partition->entry.size ? LOG_HEADER_SIZE : 0;
+    memory_status_t rc;
+
+    if (length + terminator <= PAGE_SIZE) {
+        // Small records go out in a single write
+        uint8_t record[PAGE_SIZE];
+        memcpy(record, data, length);
+        memset(&record[length], 0, terminator);
+        rc = cat25256_write(table->handle, address + LOG_HEADER_SIZE, record, length + terminator, table->cs);
+    } else {
+        rc = cat25256_write(table->handle, address + LOG_HEADER_SIZE, data, length, table->cs);
+        if (rc == MEMORY_STATUS_OK && terminator > 0) {
+            uint8_t end[LOG_HEADER_SIZE] = {0};
+            rc = cat25256_write(table->handle, partition->entry.start + next, end, sizeof end, table->cs);
+        }
+    }
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
+    uint8_t header[LOG_HEADER_SIZE];
+    cat25256_partition_put16(&header[0], length);
+    cat25256_partition_put16(&header[2], length ^ 0xFFFF);
+    rc = cat25256_write(table->handle, address, header, sizeof header, table->cs);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
+    if (offset != NULL) {
+        *offset = partition->log_head + LOG_HEADER_SIZE;
+    }
+    partition->log_head = next;
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t cat25256_partition_reset_log(cat25256_partition_table_t *table, uint8_t id) {
+    if (table == NULL || table->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+
+    cat25256_partition_t *partition = cat25256_partition_find(table, id);
+    if (partition == NULL || partition->entry.policy != CAT25256_POLICY_LOG) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    uint8_t end[LOG_HEADER_SIZE] = {0};
+    memory_status_t rc = cat25256_write(table->handle, partition->entry.start, end, sizeof end, table->cs);
+    if (rc == MEMORY_STATUS_OK) {
+        partition->log_head = 0;
+    }
+    return rc;
+}
+
+memory_status_t cat25256_partition_flush(cat25256_partition_table_t *table) {
+    if (table == NULL || table->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+
+    for (size_t i = 0; i < table->count; ++i) {
+        cat25256_partition_t *partition = &table->partitions[i];
+        for (uint8_t j = 0; j < partition->cache_slots; ++j) {
+            memory_status_t rc = cat25256_partition_write_slot(table, &partition->cache[j]);
+            if (rc != MEMORY_STATUS_OK) {
+                return rc;
+            }
+        }
+    }
+    return MEMORY_STATUS_OK;
+}
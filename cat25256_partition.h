@@ -0,0 +1,178 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAT25256_PARTITION_H
+#define _CAT25256_PARTITION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cat25256.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef CAT25256_PARTITION_MAX
+#define CAT25256_PARTITION_MAX 8
+#endif
+
+#define CAT25256_PARTITION_MAGIC        0xC5B7
+#define CAT25256_PARTITION_HEADER_SIZE  6
+#define CAT25256_PARTITION_ENTRY_SIZE   6
+#define CAT25256_PARTITION_TABLE_SIZE \
+    (CAT25256_PARTITION_HEADER_SIZE + CAT25256_PARTITION_MAX * CAT25256_PARTITION_ENTRY_SIZE)
+
+/**
+ * Write strategy of a partition
+ */
+typedef enum {
+    CAT25256_POLICY_WRITE_THROUGH = 0,
+    CAT25256_POLICY_WRITE_BACK,
+    CAT25256_POLICY_COMPARE,
+    CAT25256_POLICY_LOG,
+    CAT25256_POLICY_READ_ONLY
+} cat25256_policy_t;
+
+/**
+ * A partition as stored in the table, start and size are page aligned
+ */
+typedef struct {
+    uint8_t id;
+    uint8_t policy;
+    uint16_t start;
+    uint16_t size;
+} cat25256_partition_entry_t;
+
+/**
+ * A page cached by a write-back partition
+ */
+typedef struct {
+    uint16_t page;
+    uint8_t valid;
+    uint8_t dirty;
+    uint8_t data[CAT25256_PAGE_SIZE];
+} cat25256_cache_slot_t;
+
+typedef struct {
+    cat25256_partition_entry_t entry;
+    cat25256_cache_slot_t *cache;
+    uint8_t cache_slots;
+    uint8_t next_victim;
+    uint32_t log_head;
+} cat25256_partition_t;
+
+/**
+ * The partition table of one chip
+ */
+typedef struct {
+    cat25256_handle_t *handle;
+    size_t cs;
+    uint32_t table_address;
+    cat25256_partition_t partitions[CAT25256_PARTITION_MAX];
+    size_t count;
+} cat25256_partition_table_t;
+
+/**
+ * @brief Writes a new partition table, partitions must be page aligned and must not overlap each other or the table.
+ * The table and all partitions have to end within the capacity of the handle, mount checks the same.
+ * @param table The partition table, handle, cs and table_address must be set
+ * @param entries The partitions
+ * @param count The number of partitions, at most CAT25256_PARTITION_MAX
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure or an invalid layout
+ */
+memory_status_t
+cat25256_partition_format(cat25256_partition_table_t *table, const cat25256_partition_entry_t *entries, size_t count);
+
+/**
+ * @brief Reads the partition table with a single burst read and locates the head of every log partition.
+ * @param table The partition table, handle, cs and table_address must be set
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure or if there is no valid table
+ */
+memory_status_t cat25256_partition_mount(cat25256_partition_table_t *table);
+
+/**
+ * @brief Gives a write-back partition its RAM page cache.
+ * @param table The mounted partition table
+ * @param id The id of the partition
+ * @param slots The cache slots
+ * @param count The number of cache slots
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t
+cat25256_partition_attach_cache(cat25256_partition_table_t *table, uint8_t id, cat25256_cache_slot_t *slots,
+                                uint8_t count);
+
+/**
+ * @brief Reads from a partition.
+ * @param table The mounted partition table
+ * @param id The id of the partition
+ * @param offset The offset within the partition
+ * @param data The data buffer to read into
+ * @param length The length of the data buffer
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure, MEMORY_STATUS_OUT_OF_RANGE if the range
+ * exceeds the partition
+ */
+memory_status_t
+cat25256_partition_read(cat25256_partition_table_t *table, uint8_t id, uint32_t offset, uint8_t *data,
+                        uint32_t length);
+
+/**
+ * @brief Writes to a partition using its policy. Log partitions only accept cat25256_partition_append.
+ * @param table The mounted partition table
+ * @param id The id of the partition
+ * @param offset The offset within the partition
+ * @param data The data buffer to write
+ * @param length The length of the data buffer
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure, MEMORY_STATUS_PROTECTED for read-only
+ * partitions, MEMORY_STATUS_OUT_OF_RANGE if the range exceeds the partition
+ */
+memory_status_t
+cat25256_partition_write(cat25256_partition_table_t *table, uint8_t id, uint32_t offset, const uint8_t *data,
+                         uint32_t length);
+
+/**
+ * @brief Appends a record to a log partition.
+ * @param table The mounted partition table
+ * @param id The id of the partition
+ * @param data The record
+ * @param length The length of the record
+ * @param offset The offset of the record data within the partition, may be NULL
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure or if the log is full
+ */
+memory_status_t
+cat25256_partition_append(cat25256_partition_table_t *table, uint8_t id, const uint8_t *data, uint16_t length,
+                          uint32_t *offset);
+
+/**
+ * @brief Empties a log partition.
+ * @param table The mounted partition table
+ * @param id The id of the partition
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_partition_reset_log(cat25256_partition_table_t *table, uint8_t id);
+
+/**
+ * @brief Programs all dirty pages cached by write-back partitions.
+ * @param table The mounted partition table
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_partition_flush(cat25256_partition_table_t *table);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_CAT25256_PARTITION_H
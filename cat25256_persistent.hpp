@@ -0,0 +1,225 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAT25256_PERSISTENT_HPP
+#define _CAT25256_PERSISTENT_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include "cat25256.h"
+
+namespace cat25256 {
+
+    namespace detail {
+        /**
+         * std::type_identity for pre-C++20 compilers, keeps a parameter out of template argument deduction
+         */
+        template<typename T>
+        struct type_identity {
+            using type = T;
+        };
+    }
+
+    /**
+     * A variable of type T persisted at a fixed EEPROM address.
+     * Keeps a RAM shadow and tracks changed fields, commit() only programs the pages containing changed bytes.
+     */
+    template<typename T, uint32_t Address>
+    class persistent {
+        static_assert(std::is_trivially_copyable<T>::value, "persistent types must be trivially copyable");
+        static_assert(Address + sizeof(T) <= CAT25256_CAPACITY, "persistent variable exceeds the device capacity");
+
+    public:
+        using value_type = T;
+        static constexpr uint32_t address = Address;
+        static constexpr uint32_t size = sizeof(T);
+        static constexpr uint32_t end = Address + sizeof(T);
+
+        persistent(cat25256_handle_t *handle, size_t cs) : handle_(handle), cs_(cs), shadow_(), dirty_() {}
+
+        /**
+         * @brief Loads the shadow from the EEPROM with a single burst read and clears the dirty state.
+         * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+         */
+        memory_status_t load() {
+            memory_status_t rc = cat25256_read(handle_, Address, reinterpret_cast<uint8_t *>(&shadow_), size, cs_);
+            if (rc == MEMORY_STATUS_OK) {
+                std::memset(dirty_, 0, sizeof dirty_);
+            }
+            return rc;
+        }
+
+        const T &get() const {
+            return shadow_;
+        }
+
+        /**
+         * @brief Updates a single field of the shadow, the field is marked dirty only if its bytes change.
+         * @param field Pointer to the member to update
+         * @param value The new value, converted to the type of the field, e.g. flags | 1 for a uint16_t field
+         */
+        template<typename F>
+        void set(F T::*field, const typename detail::type_identity<F>::type &value) {
+            F &target = shadow_.*field;
+            if (std::memcmp(&target, &value, sizeof(F)) == 0) {
+                return;
+            }
+            std::memcpy(&target, &value, sizeof(F));
+            mark_dirty(offset_of(target), sizeof(F));
+        }
+
+        /**
+         * @brief Replaces the whole shadow, only the bytes that differ are marked dirty.
+         * @param value The new value
+         */
+        void set(const T &value) {
+            const uint8_t *next = reinterpret_cast<const uint8_t *>(&value);
+            uint8_t *current = reinterpret_cast<uint8_t *>(&shadow_);
+            for (uint32_t i = 0; i < size; ++i) {
+                if (current[i] != next[i]) {
+                    current[i] = next[i];
+                    mark_dirty(i, 1);
+                }
+            }
+        }
+
+        /**
+         * @brief Marks a byte range of the shadow dirty, e.g. after modifying it through a pointer.
+         * @param offset The offset of the range within T
+         * @param length The length of the range
+         */
+        void mark_dirty(uint32_t offset, uint32_t length) {
+            for (uint32_t i = offset; i < offset + length && i < size; ++i) {
+                dirty_[i / 8] |= static_cast<uint8_t>(1u << (i % 8));
+            }
+        }
+
+        bool dirty() const {
+            for (uint8_t bits : dirty_) {
+                if (bits != 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * @brief Writes the dirty bytes, one page program per page that contains any of them.
+         * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+         */
+        memory_status_t commit() {
+            const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&shadow_);
+            uint32_t offset = 0;
+
+            while (offset < size) {
+                uint32_t page_end = offset + CAT25256_PAGE_SIZE - (Address + offset) % CAT25256_PAGE_SIZE;
+                if (page_end > size) {
+                    page_end = size;
+                }
+
+                // Program the span from the first to the last dirty byte of the page
+                uint32_t first = page_end;
+                uint32_t last = offset;
+                for (uint32_t i = offset; i < page_end; ++i) {
+                    if (is_dirty(i)) {
+                        if (first == page_end) {
+                            first = i;
+                        }
+                        last = i + 1;
+                    }
+                }
+
+                if (first < page_end) {
+                    memory_status_t rc = cat25256_write_page(handle_, Address + first, &bytes[first], last - first, cs_);
+                    if (rc != MEMORY_STATUS_OK) {
+                        return rc;
+                    }
+                    for (uint32_t i = first; i < last; ++i) {
+                        dirty_[i / 8] &= static_cast<uint8_t>(~(1u << (i % 8)));
+                    }
+                }
+                offset = page_end;
+            }
+            return MEMORY_STATUS_OK;
+        }
+
+    private:
+        template<typename F>
+        uint32_t offset_of(const F &member) const {
+            return static_cast<uint32_t>(reinterpret_cast<const uint8_t *>(&member) -
+                                         reinterpret_cast<const uint8_t *>(&shadow_));
+        }
+
+        bool is_dirty(uint32_t offset) const {
+            return (dirty_[offset / 8] >> (offset % 8)) & 1u;
+        }
+
+        cat25256_handle_t *handle_;
+        size_t cs_;
+        T shadow_;
+        uint8_t dirty_[(sizeof(T) + 7) / 8];
+    };
+
+    /**
+     * The first address after the persistent variable V, rounded up to Align
+     */
+    template<typename V, uint32_t Align = 1>
+    struct after {
+        static constexpr uint32_t value = (V::end + Align - 1) / Align * Align;
+    };
+
+    namespace detail {
+        template<typename V, typename... Others>
+        struct overlaps_any;
+
+        template<typename V>
+        struct overlaps_any<V> {
+            static constexpr bool value = false;
+        };
+
+        template<typename V, typename Head, typename... Tail>
+        struct overlaps_any<V, Head, Tail...> {
+            static constexpr bool value = (V::address < Head::end && Head::address < V::end) ||
+                                          overlaps_any<V, Tail...>::value;
+        };
+
+        template<typename... Vars>
+        struct disjoint;
+
+        template<>
+        struct disjoint<> {
+            static constexpr bool value = true;
+        };
+
+        template<typename Head, typename... Tail>
+        struct disjoint<Head, Tail...> {
+            static constexpr bool value = !overlaps_any<Head, Tail...>::value && disjoint<Tail...>::value;
+        };
+    }
+
+    /**
+     * Declares the set of persistent variables sharing a device, fails to compile if any two of them overlap.
+     * Instantiate it once, e.g. static constexpr cat25256::layout<calibration_t, state_t> layout{};
+     */
+    template<typename... Vars>
+    struct layout {
+        static_assert(detail::disjoint<Vars...>::value, "persistent variables of the layout overlap");
+    };
+}
+
+#endif //_CAT25256_PERSISTENT_HPP
@@ -0,0 +1,79 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAT25256_PROFILE_H
+#define _CAT25256_PROFILE_H
+
+/**
+ * Compile-time feature profiles, select one with -DCAT25256_PROFILE=CAT25256_PROFILE_<NAME>
+ *
+ * MINIMAL: plain reads and page writes, busy polling after each program, no status shadow checks.
+ * CACHED:  MINIMAL + adaptive write-cycle wait, protection checks and readahead, for the caching modules.
+ * ASYNC:   MINIMAL + adaptive write-cycle wait, protection checks and HOLD pauses, for the time-sliced modules.
+ * FULL:    everything, including per-page program accounting for the wear counters.
+ *
+ * Every CAT25256_FEATURE_* flag can be overridden individually.
+ */
+#define CAT25256_PROFILE_MINIMAL 1
+#define CAT25256_PROFILE_CACHED  2
+#define CAT25256_PROFILE_ASYNC   3
+#define CAT25256_PROFILE_FULL    4
+
+#ifndef CAT25256_PROFILE
+#define CAT25256_PROFILE CAT25256_PROFILE_FULL
+#endif
+
+#if CAT25256_PROFILE < CAT25256_PROFILE_MINIMAL || CAT25256_PROFILE > CAT25256_PROFILE_FULL
+#error "Unknown CAT25256_PROFILE"
+#endif
+
+/**
+ * Sleep for the learned write-cycle time instead of polling the status register back to back
+ */
+#ifndef CAT25256_FEATURE_ADAPTIVE_WAIT
+#define CAT25256_FEATURE_ADAPTIVE_WAIT (CAT25256_PROFILE != CAT25256_PROFILE_MINIMAL)
+#endif
+
+/**
+ * Reject writes into block protected ranges with MEMORY_STATUS_PROTECTED, without it the chip drops them silently
+ */
+#ifndef CAT25256_FEATURE_PROTECTION_CHECK
+#define CAT25256_FEATURE_PROTECTION_CHECK (CAT25256_PROFILE != CAT25256_PROFILE_MINIMAL)
+#endif
+
+/**
+ * Count programs per page into cat25256_chip_state_t.page_programs, required by cat25256_wear.c
+ */
+#ifndef CAT25256_FEATURE_WEAR_ACCOUNTING
+#define CAT25256_FEATURE_WEAR_ACCOUNTING (CAT25256_PROFILE == CAT25256_PROFILE_FULL)
+#endif
+
+/**
+ * Prefetch ahead of sequential cat25256_read calls into the buffer of cat25256_handle_t.readahead
+ */
+#ifndef CAT25256_FEATURE_READAHEAD
+#define CAT25256_FEATURE_READAHEAD \
+    (CAT25256_PROFILE == CAT25256_PROFILE_CACHED || CAT25256_PROFILE == CAT25256_PROFILE_FULL)
+#endif
+
+/**
+ * Split long reads into chunks and pause them on HOLD for cat25256_handle_t.urgent_transfer
+ */
+#ifndef CAT25256_FEATURE_HOLD
+#define CAT25256_FEATURE_HOLD (CAT25256_PROFILE == CAT25256_PROFILE_ASYNC || CAT25256_PROFILE == CAT25256_PROFILE_FULL)
+#endif
+
+#endif //_CAT25256_PROFILE_H
@@ -0,0 +1,148 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cat25256_rmw.h"
+
+#define PAGE_SIZE CAT25256_PAGE_SIZE
+
+typedef enum {
+    RMW_CAS,
+    RMW_ADD,
+    RMW_SET,
+    RMW_CLEAR
+} cat25256_rmw_op_t;
+
+static uint32_t cat25256_rmw_load(const uint8_t *data, uint8_t width) {
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < width; ++i) {
+        value |= (uint32_t) data[i] << (8 * i);
+    }
+    return value;
+}
+
+static void cat25256_rmw_store(uint8_t *data, uint8_t width, uint32_t value) {
+    for (uint8_t i = 0; i < width; ++i) {
+        data[i] = value >> (8 * i);
+    }
+}
+
+static memory_status_t
+cat25256_rmw_locked(cat25256_rmw_t *rmw, uint32_t address, uint8_t width, cat25256_rmw_op_t op, uint32_t operand,
+                    uint32_t desired, uint32_t *previous) {
+    uint32_t page = address / PAGE_SIZE;
+    uint32_t offset = address % PAGE_SIZE;
+
+    if (!rmw->cached || rmw->cached_page != page) {
+        rmw->cached = 0;
+        memory_status_t rc = cat25256_read(rmw->handle, page * PAGE_SIZE, rmw->page, PAGE_SIZE, rmw->cs);
+        if (rc != MEMORY_STATUS_OK) {
+            return rc;
+        }
+        rmw->cached_page = page;
+        rmw->cached = 1;
+    }
+
+    uint32_t mask = width == 4 ? UINT32_MAX : ((uint32_t) 1 << (8 * width)) - 1;
+    uint32_t current = cat25256_rmw_load(&rmw->page[offset], width);
+    uint32_t next = current;
+
+    switch (op) {
+        case RMW_CAS:
+            if (current == (operand & mask)) {
+                next = desired;
+            }
+            break;
+        case RMW_ADD:
+            next = current + operand;
+            break;
+        case RMW_SET:
+            next = current | operand;
+            break;
+        case RMW_CLEAR:
+            next = current & ~operand;
+            break;
+    }
+    next &= mask;
+
+    if (previous != NULL) {
+        *previous = current;
+    }
+    if (next == current) {
+        return MEMORY_STATUS_OK;
+    }
+
+    uint8_t data[4];
+    cat25256_rmw_store(data, width, next);
+    memory_status_t rc = cat25256_write_page(rmw->handle, address, data, width, rmw->cs);
+    if (rc != MEMORY_STATUS_OK) {
+        // The outcome on the device is unknown
+        rmw->cached = 0;
+        return rc;
+    }
+
+    cat25256_rmw_store(&rmw->page[offset], width, next);
+    return MEMORY_STATUS_OK;
+}
+
+static memory_status_t
+cat25256_rmw(cat25256_rmw_t *rmw, uint32_t address, uint8_t width, cat25256_rmw_op_t op, uint32_t operand,
+             uint32_t desired, uint32_t *previous) {
+    if (rmw == NULL || rmw->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+    if ((width != 1 && width != 2 && width != 4) || address % width != 0) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    cat25256_handle_t *handle = rmw->handle;
+    if (handle->lock != NULL && handle->lock(handle->low_level_handle, rmw->cs) != MEMORY_STATUS_OK) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    memory_status_t rc = cat25256_rmw_locked(rmw, address, width, op, operand, desired, previous);
+
+    if (handle->unlock != NULL) {
+        handle->unlock(handle->low_level_handle, rmw->cs);
+    }
+    return rc;
+}
+
+memory_status_t
+cat25256_rmw_cas(cat25256_rmw_t *rmw, uint32_t address, uint8_t width, uint32_t expected, uint32_t desired,
+                 uint32_t *observed) {
+    return cat25256_rmw(rmw, address, width, RMW_CAS, expected, desired, observed);
+}
+
+memory_status_t
+cat25256_rmw_fetch_add(cat25256_rmw_t *rmw, uint32_t address, uint8_t width, uint32_t delta, uint32_t *previous) {
+    return cat25256_rmw(rmw, address, width, RMW_ADD, delta, 0, previous);
+}
+
+memory_status_t
+cat25256_rmw_bit_set(cat25256_rmw_t *rmw, uint32_t address, uint8_t width, uint32_t mask, uint32_t *previous) {
+    return cat25256_rmw(rmw, address, width, RMW_SET, mask, 0, previous);
+}
+
+memory_status_t
+cat25256_rmw_bit_clear(cat25256_rmw_t *rmw, uint32_t address, uint8_t width, uint32_t mask, uint32_t *previous) {
+    return cat25256_rmw(rmw, address, width, RMW_CLEAR, mask, 0, previous);
+}
+
+void cat25256_rmw_invalidate(cat25256_rmw_t *rmw) {
+    if (rmw != NULL) {
+        rmw->cached = 0;
+    }
+}
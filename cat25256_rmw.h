@@ -0,0 +1,107 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAT25256_RMW_H
+#define _CAT25256_RMW_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cat25256.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Read-modify-write context of one chip
+ * Keeps a copy of the last page it touched, which stays valid as long as that page is only written through
+ * this context. Call cat25256_rmw_invalidate after writing it by other means.
+ */
+typedef struct {
+    cat25256_handle_t *handle;
+    size_t cs;
+
+    uint8_t cached;
+    uint32_t cached_page;
+    uint8_t page[CAT25256_PAGE_SIZE];
+} cat25256_rmw_t;
+
+/**
+ * All operations work on naturally aligned little endian words of width 1, 2 or 4 bytes,
+ * run under the lock/unlock callbacks of the handle and skip the page program if the word does not change.
+ */
+
+/**
+ * @brief Compare-and-swap: stores desired if the word equals expected.
+ * @param rmw The read-modify-write context
+ * @param address The address of the word
+ * @param width The width of the word in bytes
+ * @param expected The value the word must have
+ * @param desired The value to store
+ * @param observed The value of the word before the operation, may be NULL
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t
+cat25256_rmw_cas(cat25256_rmw_t *rmw, uint32_t address, uint8_t width, uint32_t expected, uint32_t desired,
+                 uint32_t *observed);
+
+/**
+ * @brief Adds delta to the word, wrapping at its width.
+ * @param rmw The read-modify-write context
+ * @param address The address of the word
+ * @param width The width of the word in bytes
+ * @param delta The value to add
+ * @param previous The value of the word before the operation, may be NULL
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t
+cat25256_rmw_fetch_add(cat25256_rmw_t *rmw, uint32_t address, uint8_t width, uint32_t delta, uint32_t *previous);
+
+/**
+ * @brief Sets the bits of mask in the word.
+ * @param rmw The read-modify-write context
+ * @param address The address of the word
+ * @param width The width of the word in bytes
+ * @param mask The bits to set
+ * @param previous The value of the word before the operation, may be NULL
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t
+cat25256_rmw_bit_set(cat25256_rmw_t *rmw, uint32_t address, uint8_t width, uint32_t mask, uint32_t *previous);
+
+/**
+ * @brief Clears the bits of mask in the word.
+ * @param rmw The read-modify-write context
+ * @param address The address of the word
+ * @param width The width of the word in bytes
+ * @param mask The bits to clear
+ * @param previous The value of the word before the operation, may be NULL
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t
+cat25256_rmw_bit_clear(cat25256_rmw_t *rmw, uint32_t address, uint8_t width, uint32_t mask, uint32_t *previous);
+
+/**
+ * @brief Drops the cached page.
+ * @param rmw The read-modify-write context
+ */
+void cat25256_rmw_invalidate(cat25256_rmw_t *rmw);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_CAT25256_RMW_H
@@ -0,0 +1,298 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "cat25256_schema.h"
+#include "cat25256_crc.h"
+
+#define PAGE_SIZE CAT25256_PAGE_SIZE
+
+/**
+ * Header: magic u16, version u16, payload length u16, sequence u16, crc u16 (over the sequence and the payload)
+ * The region holds two slots, commits alternate between them and load picks the valid one with the newer
+ * sequence, so a torn commit falls back to the previous one.
+ */
+
+uint32_t cat25256_schema_image_size(const cat25256_field_t *fields, size_t field_count, uint16_t version) {
+    uint32_t size = CAT25256_SCHEMA_HEADER_SIZE;
+    for (size_t i = 0; i < field_count; ++i) {
+        if (fields[i].since_version <= version) {
+            size += fields[i].size;
+        }
+    }
+    return size;
+}
+
+static void cat25256_schema_put16(uint8_t *data, uint16_t value) {
+    data[0] = value;
+    data[1] = value >> 8;
+}
+
+static uint16_t cat25256_schema_get16(const uint8_t *data) {
+    return (uint16_t) (data[0] | data[1] << 8);
+}
+
+uint32_t cat25256_schema_slot_stride(const cat25256_schema_t *schema) {
+    uint32_t size = cat25256_schema_image_size(schema->fields, schema->field_count, schema->version);
+    return (schema->address % PAGE_SIZE + size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+}
+
+uint32_t cat25256_schema_buffer_size(const cat25256_schema_t *schema) {
+    return cat25256_schema_slot_stride(schema) +
+           cat25256_schema_image_size(schema->fields, schema->field_count, schema->version);
+}
+
+static uint32_t cat25256_schema_slot_address(const cat25256_schema_t *schema, uint8_t slot) {
+    return schema->address + slot * cat25256_schema_slot_stride(schema);
+}
+
+static memory_status_t cat25256_schema_check(const cat25256_schema_t *schema) {
+    if (schema->image == NULL || schema->data == NULL || schema->image_size < cat25256_schema_buffer_size(schema)) {
+        return MEMORY_STATUS_NOK;
+    }
+    // The header is written with a single page program
+    if (schema->address % PAGE_SIZE > PAGE_SIZE - CAT25256_SCHEMA_HEADER_SIZE) {
+        return MEMORY_STATUS_NOK;
+    }
+    return MEMORY_STATUS_OK;
+}
+
+/**
+ * Validates the image of a slot, returns its version or -1
+ */
+static int32_t cat25256_schema_validate(const cat25256_schema_t *schema, const uint8_t *image) {
+    const uint8_t *header = image;
+    uint16_t version = cat25256_schema_get16(&header[2]);
+    uint16_t length = cat25256_schema_get16(&header[4]);
+    if (cat25256_schema_get16(&header[0]) != CAT25256_SCHEMA_MAGIC || version > schema->version ||
+        length != cat25256_schema_image_size(schema->fields, schema->field_count, version) -
+                  CAT25256_SCHEMA_HEADER_SIZE) {
+        return -1;
+    }
+
+    uint16_t crc = cat25256_crc16(CAT25256_CRC16_INIT, &header[6], 2);
+    crc = cat25256_crc16(crc, &image[CAT25256_SCHEMA_HEADER_SIZE], length);
+    if (crc != cat25256_schema_get16(&header[8])) {
+        return -1;
+    }
+    return version;
+}
+
+static void
+cat25256_schema_unpack(const cat25256_schema_t *schema, const uint8_t *payload, uint16_t version) {
+    uint8_t *data = schema->data;
+    uint32_t offset = 0;
+    for (size_t i = 0; i < schema->field_count; ++i) {
+        const cat25256_field_t *field = &schema->fields[i];
+        if (field->since_version > version) {
+            continue;
+        }
+        memcpy(&data[field->offset], &payload[offset], field->size);
+        offset += field->size;
+    }
+}
+
+memory_status_t cat25256_schema_load(cat25256_schema_t *schema) {
+    if (schema == NULL || schema->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+    uint32_t size = cat25256_schema_image_size(schema->fields, schema->field_count, schema->version);
+    if (cat25256_schema_check(schema) != MEMORY_STATUS_OK) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    schema->image_valid = 0;
+    schema->slot = 0;
+    schema->sequence = 0;
+    schema->stale = UINT32_MAX;
+
+    // Both slots in one CS session, older versions are never larger than the current one
+    uint32_t stride = cat25256_schema_slot_stride(schema);
+    memory_status_t rc = cat25256_read(schema->handle, schema->address, schema->image, stride + size, schema->cs);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
+    int32_t versions[2];
+    uint16_t sequences[2];
+    for (uint8_t slot = 0; slot < 2; slot++) {
+        const uint8_t *image = &schema->image[slot * stride];
+        versions[slot] = cat25256_schema_validate(schema, image);
+        sequences[slot] = cat25256_schema_get16(&image[6]);
+    }
+
+    uint8_t slot = versions[1] >= 0 &&
+                   (versions[0] < 0 || (int16_t) (sequences[1] - sequences[0]) > 0) ? 1 : 0;
+    if (versions[slot] < 0) {
+        return MEMORY_STATUS_NOK;
+    }
+    if (slot == 1) {
+        // The image of the active slot always starts the buffer
+        memmove(schema->image, &schema->image[stride], size);
+    }
+    schema->slot = slot;
+    schema->sequence = sequences[slot];
+
+    uint16_t version = (uint16_t) versions[slot];
+    uint16_t length = cat25256_schema_get16(&schema->image[4]);
+    const uint8_t *payload = &schema->image[CAT25256_SCHEMA_HEADER_SIZE];
+    cat25256_schema_unpack(schema, payload, version);
+
+    if (version != schema->version) {
+        if (schema->migrate != NULL) {
+            rc = schema->migrate(schema->migrate_context, version, payload, length, schema->data);
+            if (rc != MEMORY_STATUS_OK) {
+                return rc;
+            }
+        }
+        // The image is in the old layout, the next commit rewrites the whole region
+        return MEMORY_STATUS_OK;
+    }
+
+    schema->image_valid = 1;
+    return MEMORY_STATUS_OK;
+}
+
+/**
+ * Copies the bytes of data overlapping [begin, end) of the current layout into the image
+ * and returns the dirty span in first/last.
+ */
+static void cat25256_schema_merge(cat25256_schema_t *schema, uint32_t begin, uint32_t end, uint32_t *first,
+                                  uint32_t *last) {
+    const uint8_t *data = schema->data;
+    uint32_t position = CAT25256_SCHEMA_HEADER_SIZE;
+
+    for (size_t i = 0; i < schema->field_count && position < end; ++i) {
+        const cat25256_field_t *field = &schema->fields[i];
+        if (field->since_version > schema->version) {
+            continue;
+        }
+        for (uint32_t j = 0; j < field->size; ++j) {
+            uint32_t at = position + j;
+            if (at < begin || at >= end) {
+                continue;
+            }
+            uint8_t value = data[field->offset + j];
+            if (!schema->image_valid || schema->image[at] != value) {
+                schema->image[at] = value;
+                if (*first > at) {
+                    *first = at;
+                }
+                if (*last < at + 1) {
+                    *last = at + 1;
+                }
+            }
+        }
+        position += field->size;
+    }
+}
+
+static uint32_t cat25256_schema_page_bit(const cat25256_schema_t *schema, uint32_t begin) {
+    // Pages past the 32nd share the last bit
+    uint32_t page = (schema->address % PAGE_SIZE + begin) / PAGE_SIZE;
+    return 1u << (page < 31 ? page : 31);
+}
+
+memory_status_t cat25256_schema_commit(cat25256_schema_t *schema) {
+    if (schema == NULL || schema->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+    uint32_t size = cat25256_schema_image_size(schema->fields, schema->field_count, schema->version);
+    if (cat25256_schema_check(schema) != MEMORY_STATUS_OK) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    uint8_t target = !schema->slot;
+    uint32_t target_address = cat25256_schema_slot_address(schema, target);
+    uint16_t sequence = schema->sequence + 1;
+    if (!schema->image_valid) {
+        schema->stale = UINT32_MAX;
+    }
+
+    // CRC over the sequence and the new payload, computed directly from the struct
+    uint8_t header[CAT25256_SCHEMA_HEADER_SIZE];
+    cat25256_schema_put16(&header[6], sequence);
+    const uint8_t *data = schema->data;
+    uint16_t crc = cat25256_crc16(CAT25256_CRC16_INIT, &header[6], 2);
+    for (size_t i = 0; i < schema->field_count; ++i) {
+        if (schema->fields[i].since_version <= schema->version) {
+            crc = cat25256_crc16(crc, &data[schema->fields[i].offset], schema->fields[i].size);
+        }
+    }
+    cat25256_schema_put16(&header[0], CAT25256_SCHEMA_MAGIC);
+    cat25256_schema_put16(&header[2], schema->version);
+    cat25256_schema_put16(&header[4], size - CAT25256_SCHEMA_HEADER_SIZE);
+    cat25256_schema_put16(&header[8], crc);
+
+    // The target slot lags the image by the pages of the previous commit (stale), those are written whole,
+    // the others only where the struct changed. The header page goes last so a torn commit fails the CRC.
+    uint32_t changed = 0;
+    uint32_t header_end = PAGE_SIZE - schema->address % PAGE_SIZE;
+    if (header_end > size) {
+        header_end = size;
+    }
+    uint32_t begin = header_end;
+    while (1) {
+        uint32_t end = begin;
+        if (begin < size) {
+            end = begin + PAGE_SIZE - (schema->address + begin) % PAGE_SIZE;
+            if (end > size) {
+                end = size;
+            }
+        } else {
+            begin = 0;
+            end = header_end;
+        }
+
+        uint32_t first = end;
+        uint32_t last = begin;
+        cat25256_schema_merge(schema, begin, end, &first, &last);
+        if (begin == 0) {
+            memcpy(schema->image, header, sizeof header);
+            first = 0;
+            last = last > CAT25256_SCHEMA_HEADER_SIZE ? last : CAT25256_SCHEMA_HEADER_SIZE;
+        }
+
+        uint32_t bit = cat25256_schema_page_bit(schema, begin);
+        if (first < last) {
+            changed |= bit;
+        }
+        if (schema->stale & bit) {
+            first = begin;
+            last = end;
+        }
+        if (first < last) {
+            memory_status_t rc = cat25256_write_page(schema->handle, target_address + first, &schema->image[first],
+                                                     last - first, schema->cs);
+            if (rc != MEMORY_STATUS_OK) {
+                schema->image_valid = 0;
+                return rc;
+            }
+        }
+
+        if (begin == 0) {
+            break;
+        }
+        begin = end;
+    }
+
+    // The slot just left behind misses exactly what changed now
+    schema->slot = target;
+    schema->sequence = sequence;
+    schema->stale = changed;
+    schema->image_valid = 1;
+    return MEMORY_STATUS_OK;
+}
@@ -0,0 +1,119 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAT25256_SCHEMA_H
+#define _CAT25256_SCHEMA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cat25256.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAT25256_SCHEMA_MAGIC       0xC5F6
+#define CAT25256_SCHEMA_HEADER_SIZE 10
+
+/**
+ * Describes a member of the config struct, fields are packed on the device in table order
+ */
+typedef struct {
+    uint16_t offset;
+    uint16_t size;
+    uint16_t since_version;
+} cat25256_field_t;
+
+#define CAT25256_FIELD(type, member, since_version) \
+    {offsetof(type, member), sizeof(((type *) 0)->member), since_version}
+
+/**
+ * Optional hook to convert a region written by an older schema version.
+ * Fields known to the old version have already been unpacked into data when it is called.
+ */
+typedef memory_status_t (*cat25256_migrate_t)(void *context, uint16_t from_version, const uint8_t *payload,
+                                              uint16_t length, void *data);
+
+/**
+ * A persisted config region of two slots, cat25256_schema_slot_stride bytes apart
+ * data is the config struct, image a buffer of cat25256_schema_buffer_size bytes. Load reads both slots into it,
+ * afterwards its first cat25256_schema_image_size bytes mirror the active slot.
+ * The header must not cross a page: address % CAT25256_PAGE_SIZE <= CAT25256_PAGE_SIZE - header size.
+ */
+typedef struct {
+    cat25256_handle_t *handle;
+    size_t cs;
+    uint32_t address;
+    uint16_t version;
+    const cat25256_field_t *fields;
+    size_t field_count;
+    void *data;
+    uint8_t *image;
+    uint32_t image_size;
+    cat25256_migrate_t migrate;
+    void *migrate_context;
+    uint8_t image_valid;
+    uint8_t slot;
+    uint16_t sequence;
+    uint32_t stale;
+} cat25256_schema_t;
+
+/**
+ * @brief Returns the size of the packed region of a schema version including its header.
+ * @param fields The field table
+ * @param field_count The number of fields
+ * @param version The schema version
+ * @return The size in bytes
+ */
+uint32_t cat25256_schema_image_size(const cat25256_field_t *fields, size_t field_count, uint16_t version);
+
+/**
+ * @brief Returns the distance of the two slots: the whole pages one image spans from address.
+ * @param schema The schema
+ * @return The stride in bytes, the region ends at most 2 * stride bytes after address
+ */
+uint32_t cat25256_schema_slot_stride(const cat25256_schema_t *schema);
+
+/**
+ * @brief Returns the size of the image buffer: one slot stride plus the image of the second slot.
+ * @param schema The schema
+ * @return The size in bytes
+ */
+uint32_t cat25256_schema_buffer_size(const cat25256_schema_t *schema);
+
+/**
+ * @brief Loads both slots with a single burst read, validates them and unpacks the newer one into data.
+ * Regions of older versions are migrated, the next commit rewrites them in the current layout.
+ * If the region is blank or corrupt, data keeps its contents (the defaults) and MEMORY_STATUS_NOK is returned.
+ * @param schema The config region
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_schema_load(cat25256_schema_t *schema);
+
+/**
+ * @brief Writes the state of data into the other slot, the header page last, so a torn commit keeps the
+ * previous one. Only pages that changed since load or the last commit, or that the other slot missed in the
+ * previous commit, are programmed.
+ * @param schema The config region
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_schema_commit(cat25256_schema_t *schema);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_CAT25256_SCHEMA_H
@@ -0,0 +1,185 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "cat25256_typed.h"
+
+static const uint8_t type_sizes[] = {1, 2, 4, 8, 4};
+
+static uint64_t cat25256_typed_get(const uint8_t *data, uint8_t size) {
+    uint64_t value = 0;
+    for (uint8_t i = size; i > 0; i--) {
+        value = (value << 8) | data[i - 1];
+    }
+    return value;
+}
+
+static void cat25256_typed_put(uint8_t *data, uint64_t value, uint8_t size) {
+    for (uint8_t i = 0; i < size; i++) {
+        data[i] = (uint8_t) (value >> (8 * i));
+    }
+}
+
+static memory_status_t
+cat25256_typed_read(cat25256_handle_t *handle, uint32_t address, uint64_t *value, uint8_t size, size_t cs) {
+    uint8_t data[8];
+    memory_status_t rc = cat25256_read(handle, address, data, size, cs);
+    if (rc == MEMORY_STATUS_OK) {
+        *value = cat25256_typed_get(data, size);
+    }
+    return rc;
+}
+
+static memory_status_t
+cat25256_typed_write(cat25256_handle_t *handle, uint32_t address, uint64_t value, uint8_t size, size_t cs) {
+    uint8_t data[8];
+    cat25256_typed_put(data, value, size);
+    return cat25256_write(handle, address, data, size, cs);
+}
+
+memory_status_t cat25256_read_u16(cat25256_handle_t *handle, uint32_t address, uint16_t *value, size_t cs) {
+    uint64_t raw;
+    memory_status_t rc = cat25256_typed_read(handle, address, &raw, 2, cs);
+    if (rc == MEMORY_STATUS_OK) {
+        *value = (uint16_t) raw;
+    }
+    return rc;
+}
+
+memory_status_t cat25256_read_u32(cat25256_handle_t *handle, uint32_t address, uint32_t *value, size_t cs) {
+    uint64_t raw;
+    memory_status_t rc = cat25256_typed_read(handle, address, &raw, 4, cs);
+    if (rc == MEMORY_STATUS_OK) {
+        *value = (uint32_t) raw;
+    }
+    return rc;
+}
+
+memory_status_t cat25256_read_u64(cat25256_handle_t *handle, uint32_t address, uint64_t *value, size_t cs) {
+    return cat25256_typed_read(handle, address, value, 8, cs);
+}
+
+memory_status_t cat25256_read_f32(cat25256_handle_t *handle, uint32_t address, float *value, size_t cs) {
+    uint32_t bits;
+    memory_status_t rc = cat25256_read_u32(handle, address, &bits, cs);
+    if (rc == MEMORY_STATUS_OK) {
+        memcpy(value, &bits, sizeof bits);
+    }
+    return rc;
+}
+
+memory_status_t cat25256_write_u16(cat25256_handle_t *handle, uint32_t address, uint16_t value, size_t cs) {
+    return cat25256_typed_write(handle, address, value, 2, cs);
+}
+
+memory_status_t cat25256_write_u32(cat25256_handle_t *handle, uint32_t address, uint32_t value, size_t cs) {
+    return cat25256_typed_write(handle, address, value, 4, cs);
+}
+
+memory_status_t cat25256_write_u64(cat25256_handle_t *handle, uint32_t address, uint64_t value, size_t cs) {
+    return cat25256_typed_write(handle, address, value, 8, cs);
+}
+
+memory_status_t cat25256_write_f32(cat25256_handle_t *handle, uint32_t address, float value, size_t cs) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof bits);
+    return cat25256_typed_write(handle, address, bits, 4, cs);
+}
+
+static void cat25256_typed_store(const cat25256_typed_field_t *field, const uint8_t *data) {
+    uint64_t raw = cat25256_typed_get(data, type_sizes[field->type]);
+    switch (field->type) {
+        case CAT25256_TYPE_U8:
+            *(uint8_t *) field->value = (uint8_t) raw;
+            break;
+        case CAT25256_TYPE_U16:
+            *(uint16_t *) field->value = (uint16_t) raw;
+            break;
+        case CAT25256_TYPE_U32:
+            *(uint32_t *) field->value = (uint32_t) raw;
+            break;
+        case CAT25256_TYPE_U64:
+            *(uint64_t *) field->value = raw;
+            break;
+        case CAT25256_TYPE_F32: {
+            uint32_t bits = (uint32_t) raw;
+            memcpy(field->value, &bits, sizeof bits);
+            break;
+        }
+    }
+}
+
+memory_status_t
+cat25256_gather_read(cat25256_handle_t *handle, cat25256_typed_field_t *fields, size_t count, uint32_t max_gap,
+                     uint32_t *bursts, size_t cs) {
+    if (bursts != NULL) {
+        *bursts = 0;
+    }
+    if (fields == NULL && count > 0) {
+        return MEMORY_STATUS_NOK;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (fields[i].type > CAT25256_TYPE_F32 || fields[i].value == NULL) {
+            return MEMORY_STATUS_NOK;
+        }
+    }
+    if (max_gap == 0) {
+        max_gap = CAT25256_GATHER_MAX_GAP;
+    }
+
+    // Insertion sort, field lists are short and often already in order
+    for (size_t i = 1; i < count; i++) {
+        cat25256_typed_field_t field = fields[i];
+        size_t j = i;
+        while (j > 0 && fields[j - 1].address > field.address) {
+            fields[j] = fields[j - 1];
+            j--;
+        }
+        fields[j] = field;
+    }
+
+    uint8_t burst[CAT25256_GATHER_BURST_SIZE];
+    size_t first = 0;
+    while (first < count) {
+        // Grow the burst while the next field is close enough and the burst still fits the buffer
+        uint32_t start = fields[first].address;
+        uint32_t end = start + type_sizes[fields[first].type];
+        size_t last = first + 1;
+        while (last < count) {
+            uint32_t field_end = fields[last].address + type_sizes[fields[last].type];
+            uint32_t new_end = field_end > end ? field_end : end;
+            if (fields[last].address > end + max_gap || new_end - start > sizeof burst) {
+                break;
+            }
+            end = new_end;
+            last++;
+        }
+
+        memory_status_t rc = cat25256_read(handle, start, burst, end - start, cs);
+        if (rc != MEMORY_STATUS_OK) {
+            return rc;
+        }
+        if (bursts != NULL) {
+            (*bursts)++;
+        }
+
+        for (size_t i = first; i < last; i++) {
+            cat25256_typed_store(&fields[i], &burst[fields[i].address - start]);
+        }
+        first = last;
+    }
+    return MEMORY_STATUS_OK;
+}
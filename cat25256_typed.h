@@ -0,0 +1,102 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAT25256_TYPED_H
+#define _CAT25256_TYPED_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cat25256.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Largest gap in bytes that a gather read bridges by reading through it instead of starting a new burst,
+ * a new burst costs the 3 bytes of command and address plus a chip select cycle
+ */
+#ifndef CAT25256_GATHER_MAX_GAP
+#define CAT25256_GATHER_MAX_GAP 3
+#endif
+
+/**
+ * Longest burst of a gather read, it is staged on the stack
+ */
+#ifndef CAT25256_GATHER_BURST_SIZE
+#define CAT25256_GATHER_BURST_SIZE 128
+#endif
+
+/**
+ * Values are stored little endian on the device regardless of the host
+ */
+typedef enum {
+    CAT25256_TYPE_U8 = 0,
+    CAT25256_TYPE_U16,
+    CAT25256_TYPE_U32,
+    CAT25256_TYPE_U64,
+    CAT25256_TYPE_F32
+} cat25256_type_t;
+
+/**
+ * One field of a gather read, value points to a host variable of the matching type
+ */
+typedef struct {
+    uint32_t address;
+    cat25256_type_t type;
+    void *value;
+} cat25256_typed_field_t;
+
+/**
+ * Typed single value accessors, one burst per value. MEMORY_STATUS_OK on success, the status of
+ * cat25256_read/cat25256_write otherwise.
+ */
+memory_status_t cat25256_read_u16(cat25256_handle_t *handle, uint32_t address, uint16_t *value, size_t cs);
+
+memory_status_t cat25256_read_u32(cat25256_handle_t *handle, uint32_t address, uint32_t *value, size_t cs);
+
+memory_status_t cat25256_read_u64(cat25256_handle_t *handle, uint32_t address, uint64_t *value, size_t cs);
+
+memory_status_t cat25256_read_f32(cat25256_handle_t *handle, uint32_t address, float *value, size_t cs);
+
+memory_status_t cat25256_write_u16(cat25256_handle_t *handle, uint32_t address, uint16_t value, size_t cs);
+
+memory_status_t cat25256_write_u32(cat25256_handle_t *handle, uint32_t address, uint32_t value, size_t cs);
+
+memory_status_t cat25256_write_u64(cat25256_handle_t *handle, uint32_t address, uint64_t value, size_t cs);
+
+memory_status_t cat25256_write_f32(cat25256_handle_t *handle, uint32_t address, float value, size_t cs);
+
+/**
+ * @brief Reads a list of typed fields with as few bursts as possible.
+ * The fields are sorted by address in place, fields closer than max_gap bytes share one burst.
+ * @param handle The handle
+ * @param fields The fields
+ * @param count The number of fields
+ * @param max_gap The largest gap read through, 0 selects CAT25256_GATHER_MAX_GAP
+ * @param bursts The number of bursts issued, may be NULL
+ * @param cs The chip select
+ * @return MEMORY_STATUS_OK on success, the status of the failing read otherwise
+ */
+memory_status_t
+cat25256_gather_read(cat25256_handle_t *handle, cat25256_typed_field_t *fields, size_t count, uint32_t max_gap,
+                     uint32_t *bursts, size_t cs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_CAT25256_TYPED_H
@@ -0,0 +1,257 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "cat25256_wear.h"
+#include "cat25256_crc.h"
+
+#if !CAT25256_FEATURE_WEAR_ACCOUNTING
+#error "cat25256_wear.c requires CAT25256_FEATURE_WEAR_ACCOUNTING"
+#endif
+
+#define PAGE_SIZE CAT25256_PAGE_SIZE
+
+/**
+ * Snapshot layout, little endian:
+ * magic u16, page_count u16, first_page u16, crc u16 (over the counters), sequence u32, counters u32[page_count]
+ */
+
+static uint16_t cat25256_wear_get16(const uint8_t *data) {
+    return (uint16_t) (data[0] | data[1] << 8);
+}
+
+static uint32_t cat25256_wear_get32(const uint8_t *data) {
+    return (uint32_t) data[0] | (uint32_t) data[1] << 8 | (uint32_t) data[2] << 16 | (uint32_t) data[3] << 24;
+}
+
+static void cat25256_wear_put16(uint8_t *data, uint16_t value) {
+    data[0] = value;
+    data[1] = value >> 8;
+}
+
+static void cat25256_wear_put32(uint8_t *data, uint32_t value) {
+    data[0] = value;
+    data[1] = value >> 8;
+    data[2] = value >> 16;
+    data[3] = value >> 24;
+}
+
+static memory_status_t
+cat25256_wear_check_header(const uint8_t *header, uint16_t page_count, uint16_t *first_page, uint32_t *sequence) {
+    if (cat25256_wear_get16(&header[0]) != CAT25256_WEAR_MAGIC || cat25256_wear_get16(&header[2]) != page_count) {
+        return MEMORY_STATUS_NOK;
+    }
+    *first_page = cat25256_wear_get16(&header[4]);
+    *sequence = cat25256_wear_get32(&header[8]);
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t cat25256_wear_decode(const uint8_t *slot, uint16_t page_count, uint16_t *first_page,
+                                     uint32_t *counters, uint32_t *sequence) {
+    if (slot == NULL || first_page == NULL || counters == NULL || sequence == NULL) {
+        return MEMORY_STATUS_NOK;
+    }
+    if (cat25256_wear_check_header(slot, page_count, first_page, sequence) != MEMORY_STATUS_OK) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    const uint8_t *body = &slot[CAT25256_WEAR_HEADER_SIZE];
+    if (cat25256_crc16(CAT25256_CRC16_INIT, body, 4 * (size_t) page_count) != cat25256_wear_get16(&slot[6])) {
+        return MEMORY_STATUS_NOK;
+    }
+    for (uint16_t i = 0; i < page_count; ++i) {
+        counters[i] = cat25256_wear_get32(&body[4 * i]);
+    }
+    return MEMORY_STATUS_OK;
+}
+
+static memory_status_t cat25256_wear_load_slot(cat25256_wear_t *wear, uint8_t slot, uint32_t *sequence) {
+    uint32_t address = wear->area + slot * CAT25256_WEAR_SLOT_SIZE(wear->page_count);
+    uint8_t header[CAT25256_WEAR_HEADER_SIZE];
+    uint16_t first_page;
+
+    memory_status_t rc = cat25256_read(wear->handle, address, header, sizeof header, wear->cs);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+    if (cat25256_wear_check_header(header, wear->page_count, &first_page, sequence) != MEMORY_STATUS_OK ||
+        first_page != wear->first_page) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    // Read the counters as raw bytes and decode them in place
+    uint8_t *body = (uint8_t *) wear->counters;
+    rc = cat25256_read(wear->handle, address + CAT25256_WEAR_HEADER_SIZE, body, 4 * wear->page_count, wear->cs);
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+    if (cat25256_crc16(CAT25256_CRC16_INIT, body, 4 * (size_t) wear->page_count) != cat25256_wear_get16(&header[6])) {
+        return MEMORY_STATUS_NOK;
+    }
+    for (uint16_t i = 0; i < wear->page_count; ++i) {
+        wear->counters[i] = cat25256_wear_get32(&body[4 * i]);
+    }
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t cat25256_wear_attach(cat25256_wear_t *wear) {
+    if (wear == NULL || wear->handle == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+    if (wear->counters == NULL || wear->cs >= CAT25256_MAX_CS || wear->slots < 2 || wear->slots > 8 ||
+        wear->area % PAGE_SIZE != 0) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    // Load the newest snapshot, falling back to older slots if it is torn
+    uint8_t rejected = 0;
+    uint8_t newest;
+    uint32_t sequence = 0;
+    while (1) {
+        newest = wear->slots;
+        for (uint8_t slot = 0; slot < wear->slots; ++slot) {
+            uint8_t header[CAT25256_WEAR_HEADER_SIZE];
+            uint16_t first_page;
+            uint32_t candidate;
+            uint32_t address = wear->area + slot * CAT25256_WEAR_SLOT_SIZE(wear->page_count);
+
+            if (rejected & (1 << slot)) {
+                continue;
+            }
+            memory_status_t rc = cat25256_read(wear->handle, address, header, sizeof header, wear->cs);
+            if (rc != MEMORY_STATUS_OK) {
+                return rc;
+            }
+            if (cat25256_wear_check_header(header, wear->page_count, &first_page, &candidate) == MEMORY_STATUS_OK &&
+                first_page == wear->first_page && (newest == wear->slots || candidate > sequence)) {
+                newest = slot;
+                sequence = candidate;
+            }
+        }
+
+        if (newest == wear->slots) {
+            memset(wear->counters, 0, 4 * (size_t) wear->page_count);
+            sequence = 0;
+            break;
+        }
+        if (cat25256_wear_load_slot(wear, newest, &sequence) == MEMORY_STATUS_OK) {
+            break;
+        }
+        rejected |= 1 << newest;
+    }
+
+    wear->sequence = sequence;
+    wear->next_slot = newest == wear->slots ? 0 : (newest + 1) % wear->slots;
+
+    cat25256_chip_state_t *chip = &wear->handle->chip[wear->cs];
+    chip->page_programs = wear->counters;
+    chip->first_page = wear->first_page;
+    chip->page_count = wear->page_count;
+    wear->persisted_at = chip->programs;
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t cat25256_wear_poll(cat25256_wear_t *wear) {
+    if (wear == NULL || wear->handle == NULL || wear->cs >= CAT25256_MAX_CS) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+
+    if (wear->handle->chip[wear->cs].programs - wear->persisted_at < wear->persist_interval) {
+        return MEMORY_STATUS_OK;
+    }
+    return cat25256_wear_persist(wear);
+}
+
+memory_status_t cat25256_wear_persist(cat25256_wear_t *wear) {
+    if (wear == NULL || wear->handle == NULL || wear->cs >= CAT25256_MAX_CS) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+    if (wear->counters == NULL || wear->slots < 2) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    cat25256_chip_state_t *chip = &wear->handle->chip[wear->cs];
+    uint32_t address = wear->area + wear->next_slot * CAT25256_WEAR_SLOT_SIZE(wear->page_count);
+    uint32_t size = CAT25256_WEAR_HEADER_SIZE + 4 * (uint32_t) wear->page_count;
+    uint32_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32_t sequence = wear->sequence + 1;
+
+    uint16_t crc = CAT25256_CRC16_INIT;
+    for (uint16_t i = 0; i < wear->page_count; ++i) {
+        uint8_t value[4];
+        cat25256_wear_put32(value, wear->counters[i]);
+        crc = cat25256_crc16(crc, value, sizeof value);
+    }
+
+    // Stop counting while the slot is programmed, the snapshot must stay consistent with its CRC
+    chip->page_programs = NULL;
+
+    // One program per slot page, the header page goes last so a torn snapshot never looks valid
+    memory_status_t rc = MEMORY_STATUS_OK;
+    uint32_t written = 0;
+    for (; written < pages; ++written) {
+        uint8_t page[PAGE_SIZE];
+        uint32_t begin = (written + 1) % pages * PAGE_SIZE;
+        uint32_t end = begin + PAGE_SIZE > size ? size : begin + PAGE_SIZE;
+
+        for (uint32_t at = begin < CAT25256_WEAR_HEADER_SIZE ? CAT25256_WEAR_HEADER_SIZE : begin; at < end; ++at) {
+            uint32_t offset = at - CAT25256_WEAR_HEADER_SIZE;
+            page[at - begin] = (uint8_t) (wear->counters[offset / 4] >> (8 * (offset % 4)));
+        }
+        if (begin == 0) {
+            cat25256_wear_put16(&page[0], CAT25256_WEAR_MAGIC);
+            cat25256_wear_put16(&page[2], wear->page_count);
+            cat25256_wear_put16(&page[4], wear->first_page);
+            cat25256_wear_put16(&page[6], crc);
+            cat25256_wear_put32(&page[8], sequence);
+        }
+
+        rc = cat25256_write_page(wear->handle, address + begin, page, end - begin, wear->cs);
+        if (rc != MEMORY_STATUS_OK) {
+            break;
+        }
+    }
+
+    // Account the programs of the snapshot itself
+    chip->page_programs = wear->counters;
+    for (uint32_t n = 0; n < written; ++n) {
+        uint32_t page = address / PAGE_SIZE + (n + 1) % pages;
+        if (page >= wear->first_page && page - wear->first_page < wear->page_count) {
+            wear->counters[page - wear->first_page]++;
+        }
+    }
+
+    if (rc != MEMORY_STATUS_OK) {
+        return rc;
+    }
+
+    wear->sequence = sequence;
+    wear->next_slot = (wear->next_slot + 1) % wear->slots;
+    wear->persisted_at = chip->programs;
+    return MEMORY_STATUS_OK;
+}
+
+memory_status_t cat25256_wear_heatmap(const cat25256_wear_t *wear, uint16_t *permille, size_t count) {
+    if (wear == NULL || permille == NULL || wear->counters == NULL || count > wear->page_count) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t value = (uint64_t) wear->counters[i] * 1000 / CAT25256_ENDURANCE_CYCLES;
+        permille[i] = value > 1000 ? 1000 : (uint16_t) value;
+    }
+    return MEMORY_STATUS_OK;
+}
@@ -0,0 +1,103 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAT25256_WEAR_H
+#define _CAT25256_WEAR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cat25256.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAT25256_WEAR_MAGIC        0xC5E4
+#define CAT25256_WEAR_HEADER_SIZE  12
+
+/**
+ * Size of one snapshot slot in bytes, slots are page aligned
+ */
+#define CAT25256_WEAR_SLOT_SIZE(page_count) \
+    (((CAT25256_WEAR_HEADER_SIZE + 4 * (page_count)) + CAT25256_PAGE_SIZE - 1) / CAT25256_PAGE_SIZE * CAT25256_PAGE_SIZE)
+
+/**
+ * Per-page program counters of one chip
+ * The counters of pages [first_page, first_page + page_count) are kept in RAM and persisted every
+ * persist_interval programs, rotating over 2 to 8 snapshot slots starting at the page aligned area.
+ */
+typedef struct {
+    cat25256_handle_t *handle;
+    size_t cs;
+    uint16_t first_page;
+    uint16_t page_count;
+    uint32_t *counters;
+    uint32_t area;
+    uint8_t slots;
+    uint32_t persist_interval;
+
+    uint32_t sequence;
+    uint8_t next_slot;
+    uint32_t persisted_at;
+} cat25256_wear_t;
+
+/**
+ * @brief Restores the counters from the newest valid snapshot and lets the driver count page programs.
+ * @param wear The wear counters
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_wear_attach(cat25256_wear_t *wear);
+
+/**
+ * @brief Persists the counters if persist_interval programs happened since the last snapshot, call it periodically.
+ * @param wear The wear counters
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_wear_poll(cat25256_wear_t *wear);
+
+/**
+ * @brief Writes a snapshot of the counters into the next slot, page by page.
+ * @param wear The wear counters
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_wear_persist(cat25256_wear_t *wear);
+
+/**
+ * @brief Exports the heatmap of the tracked pages as consumed endurance in permille.
+ * @param wear The wear counters
+ * @param permille One value per tracked page
+ * @param count The number of values, at most page_count
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on failure
+ */
+memory_status_t cat25256_wear_heatmap(const cat25256_wear_t *wear, uint16_t *permille, size_t count);
+
+/**
+ * @brief Decodes a snapshot slot from a memory image, e.g. a dump read by a host tool.
+ * @param slot The slot contents, at least CAT25256_WEAR_SLOT_SIZE(page_count) bytes
+ * @param page_count The number of tracked pages
+ * @param first_page The first tracked page stored in the snapshot
+ * @param counters The decoded counters, page_count entries
+ * @param sequence The sequence number of the snapshot
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK if the slot holds no valid snapshot
+ */
+memory_status_t cat25256_wear_decode(const uint8_t *slot, uint16_t page_count, uint16_t *first_page,
+                                     uint32_t *counters, uint32_t *sequence);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_CAT25256_WEAR_H
@@ -0,0 +1,28 @@
+# Fails if a profile library references the heap allocator from any of its objects.
+# Invoked by the no_heap tests with NM_TOOL and LIBRARY set.
+
+execute_process(COMMAND ${NM_TOOL} -u ${LIBRARY} OUTPUT_VARIABLE output RESULT_VARIABLE result)
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "${NM_TOOL} failed on ${LIBRARY}")
+endif ()
+
+set(allocators malloc calloc realloc reallocarray free aligned_alloc posix_memalign memalign valloc pvalloc strdup
+        strndup)
+string(REPLACE "\n" ";" lines "${output}")
+set(found)
+foreach (line IN LISTS lines)
+    # "U symbol", Mach-O prefixes C symbols with an underscore
+    if (line MATCHES "^[ \t]*U[ \t]+_?([A-Za-z_0-9]+)")
+        set(symbol ${CMAKE_MATCH_1})
+        list(FIND allocators ${symbol} index)
+        if (NOT index EQUAL -1)
+            list(APPEND found ${symbol})
+        endif ()
+    endif ()
+endforeach ()
+
+if (found)
+    list(REMOVE_DUPLICATES found)
+    message(FATAL_ERROR "${LIBRARY} references the heap: ${found}")
+endif ()
+message("${LIBRARY}: no heap references")
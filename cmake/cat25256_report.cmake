@@ -0,0 +1,46 @@
+# Prints .text/.data/.bss per profile library and runs the benchmark of every profile.
+# Invoked by the report target with SIZE_TOOL, PROFILES, LIBRARIES and BENCHES set.
+
+list(LENGTH PROFILES count)
+math(EXPR last "${count} - 1")
+
+message("profile       text     data      bss")
+foreach (i RANGE ${last})
+    list(GET PROFILES ${i} profile)
+    list(GET LIBRARIES ${i} library)
+    if (SIZE_TOOL)
+        execute_process(COMMAND ${SIZE_TOOL} -t ${library} OUTPUT_VARIABLE output RESULT_VARIABLE result)
+        # The last line holds the totals over all objects of the archive
+        string(REGEX MATCH "([0-9]+)[ \t]+([0-9]+)[ \t]+([0-9]+)[ \t]+[0-9]+[ \t]+[0-9a-f]+[ \t]+\\(TOTALS\\)" totals "${output}")
+        if (result EQUAL 0 AND totals)
+            string(REPEAT " " 8 pad)
+            set(text "${pad}${CMAKE_MATCH_1}")
+            set(data "${pad}${CMAKE_MATCH_2}")
+            set(bss "${pad}${CMAKE_MATCH_3}")
+            string(SUBSTRING "${profile}        " 0 8 name)
+            string(LENGTH "${text}" length)
+            math(EXPR start "${length} - 8")
+            string(SUBSTRING "${text}" ${start} 8 text)
+            string(LENGTH "${data}" length)
+            math(EXPR start "${length} - 8")
+            string(SUBSTRING "${data}" ${start} 8 data)
+            string(LENGTH "${bss}" length)
+            math(EXPR start "${length} - 8")
+            string(SUBSTRING "${bss}" ${start} 8 bss)
+            message("${name} ${text} ${data} ${bss}")
+        else ()
+            message("${profile}: size failed")
+        endif ()
+    else ()
+        message("${profile}: no size tool found")
+    endif ()
+endforeach ()
+
+foreach (bench IN LISTS BENCHES)
+    message("")
+    execute_process(COMMAND ${bench} OUTPUT_VARIABLE output RESULT_VARIABLE result)
+    message("${output}")
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "${bench} failed")
+    endif ()
+endforeach ()
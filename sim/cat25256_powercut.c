@@ -0,0 +1,127 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "cat25256_powercut.h"
+
+static void cat25256_powercut_boot(cat25256_sim_t *sim, cat25256_handle_t *handle) {
+    memset(handle, 0, sizeof *handle);
+    cat25256_sim_attach(sim, handle);
+}
+
+static void cat25256_powercut_attempt(cat25256_powercut_t *sweep, const cat25256_powercut_app_t *app,
+                                      const cat25256_cut_t *cut, cat25256_cut_result_t *result) {
+    cat25256_handle_t handle;
+    sweep->sim = sweep->snapshot;
+    cat25256_sim_set_cut(&sweep->sim, cut);
+    cat25256_powercut_boot(&sweep->sim, &handle);
+    app->run(app->context, &handle);
+
+    // A cut after the last transaction never fires, the run simply completed
+    memset(result, 0, sizeof *result);
+    result->cut = *cut;
+    result->torn = sweep->sim.torn;
+    cat25256_sim_power_on(&sweep->sim);
+
+    cat25256_powercut_boot(&sweep->sim, &handle);
+    cat25256_sim_reset_stats(&sweep->sim);
+    uint64_t start = cat25256_sim_now_ns(&sweep->sim);
+    result->recovered = app->recover(app->context, &handle);
+    result->recovery_us = (uint32_t) ((cat25256_sim_now_ns(&sweep->sim) - start) / 1000u);
+    result->recovery_transactions = sweep->sim.stats.transactions;
+    result->recovery_programs = sweep->sim.stats.page_programs;
+    result->recovery_bus_bytes = sweep->sim.stats.bus_bytes;
+
+    sweep->cuts++;
+    if (result->recovered != MEMORY_STATUS_OK) {
+        sweep->failures++;
+    }
+    sweep->total_recovery_us += result->recovery_us;
+    if (result->recovery_us > sweep->max_recovery_us) {
+        sweep->max_recovery_us = result->recovery_us;
+    }
+    if (sweep->report != NULL) {
+        sweep->report(sweep->report_context, result);
+    }
+}
+
+static void cat25256_powercut_point(cat25256_powercut_t *sweep, const cat25256_powercut_app_t *app,
+                                    cat25256_cut_t *cut) {
+    cat25256_cut_result_t result;
+    cut->torn = CAT25256_TORN_OLD;
+    cat25256_powercut_attempt(sweep, app, cut, &result);
+    if (!result.torn) {
+        return;
+    }
+    // The cut hit a write cycle, the other outcomes of the page are just as likely
+    cut->torn = CAT25256_TORN_NEW;
+    cat25256_powercut_attempt(sweep, app, cut, &result);
+    cut->torn = CAT25256_TORN_MIXED;
+    cat25256_powercut_attempt(sweep, app, cut, &result);
+}
+
+memory_status_t cat25256_powercut_sweep(cat25256_powercut_t *sweep, const cat25256_powercut_app_t *app) {
+    if (sweep == NULL || app == NULL || app->prepare == NULL || app->run == NULL || app->recover == NULL) {
+        return MEMORY_STATUS_NOK;
+    }
+    sweep->cuts = 0;
+    sweep->failures = 0;
+    sweep->max_recovery_us = 0;
+    sweep->total_recovery_us = 0;
+
+    cat25256_handle_t handle;
+    cat25256_sim_init(&sweep->sim, sweep->spi_clock_hz, sweep->write_cycle_us);
+    cat25256_powercut_boot(&sweep->sim, &handle);
+    if (app->prepare(app->context, &handle) != MEMORY_STATUS_OK) {
+        return MEMORY_STATUS_NOK;
+    }
+    sweep->snapshot = sweep->sim;
+
+    // The uninterrupted reference run sets the range of cut points
+    cat25256_powercut_boot(&sweep->sim, &handle);
+    uint32_t transactions = sweep->sim.total_transactions;
+    uint32_t programs = sweep->sim.total_programs;
+    uint64_t start = cat25256_sim_now_ns(&sweep->sim);
+    if (app->run(app->context, &handle) != MEMORY_STATUS_OK) {
+        return MEMORY_STATUS_NOK;
+    }
+    sweep->reference_transactions = sweep->sim.total_transactions - transactions;
+    sweep->reference_programs = sweep->sim.total_programs - programs;
+    sweep->reference_ns = cat25256_sim_now_ns(&sweep->sim) - start;
+
+    cat25256_cut_t cut = {.trigger = sweep->trigger, .seed = sweep->seed};
+    if (cut.trigger == CAT25256_CUT_AT_TIME) {
+        if (sweep->time_step_us == 0) {
+            return MEMORY_STATUS_NOK;
+        }
+        for (uint64_t t = sweep->time_step_us * 1000ull; t < sweep->reference_ns; t += sweep->time_step_us * 1000ull) {
+            cut.time_ns = start + t;
+            cat25256_powercut_point(sweep, app, &cut);
+        }
+    } else if (cut.trigger == CAT25256_CUT_DURING_PROGRAM) {
+        for (uint32_t n = 1; n <= sweep->reference_programs; n++) {
+            cut.program = programs + n;
+            cat25256_powercut_point(sweep, app, &cut);
+        }
+    } else {
+        cut.trigger = CAT25256_CUT_AFTER_TRANSACTIONS;
+        for (uint32_t n = 0; n < sweep->reference_transactions; n++) {
+            cut.transactions = transactions + n;
+            cat25256_powercut_point(sweep, app, &cut);
+        }
+    }
+    return MEMORY_STATUS_OK;
+}
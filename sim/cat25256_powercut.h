@@ -0,0 +1,99 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAT25256_POWERCUT_H
+#define _CAT25256_POWERCUT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cat25256.h"
+#include "cat25256_sim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The application under test, every callback gets a fresh handle on the simulator
+ * prepare brings the image into its initial state without cuts, run is the sequence that gets interrupted and
+ * recover is the restart: mount and check consistency, MEMORY_STATUS_OK if the data survived as promised.
+ */
+typedef struct {
+    void *context;
+
+    memory_status_t (*prepare)(void *context, cat25256_handle_t *handle);
+
+    memory_status_t (*run)(void *context, cat25256_handle_t *handle);
+
+    memory_status_t (*recover)(void *context, cat25256_handle_t *handle);
+} cat25256_powercut_app_t;
+
+/**
+ * Outcome of one cut point
+ */
+typedef struct {
+    cat25256_cut_t cut;
+    uint8_t torn;
+    memory_status_t recovered;
+    uint32_t recovery_us;
+    uint32_t recovery_transactions;
+    uint32_t recovery_programs;
+    uint32_t recovery_bus_bytes;
+} cat25256_cut_result_t;
+
+/**
+ * An exhaustive sweep over the reference run, by trigger: a cut after every transaction (the default), every
+ * time_step_us or at the start of every page program.
+ * Cuts that hit a write cycle are repeated for old, new and mixed page contents.
+ * Configure spi_clock_hz, write_cycle_us, seed, trigger, time_step_us and report, the remaining members are the
+ * summary.
+ */
+typedef struct {
+    uint32_t spi_clock_hz;
+    uint32_t write_cycle_us;
+    uint64_t seed;
+    cat25256_cut_trigger_t trigger;
+    uint32_t time_step_us;
+
+    void (*report)(void *context, const cat25256_cut_result_t *result);
+
+    void *report_context;
+
+    uint32_t reference_transactions;
+    uint32_t reference_programs;
+    uint64_t reference_ns;
+    uint32_t cuts;
+    uint32_t failures;
+    uint32_t max_recovery_us;
+    uint64_t total_recovery_us;
+
+    cat25256_sim_t sim;
+    cat25256_sim_t snapshot;
+} cat25256_powercut_t;
+
+/**
+ * @brief Runs the sweep, keep the sweep static, it holds two simulated chips.
+ * @param sweep The sweep
+ * @param app The application under test
+ * @return MEMORY_STATUS_OK if the sweep ran, MEMORY_STATUS_NOK if prepare or the uninterrupted run fail
+ */
+memory_status_t cat25256_powercut_sweep(cat25256_powercut_t *sweep, const cat25256_powercut_app_t *app);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_CAT25256_POWERCUT_H
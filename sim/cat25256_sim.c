@@ -0,0 +1,356 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "cat25256_sim.h"
+
+#define WREN    0b00000110
+#define WRDI    0b00000100
+#define RDSR    0b00000101
+#define WRSR    0b00000001
+#define READ    0b00000011
+#define WRITE   0b00000010
+
+#define NREADY     0x01
+#define WEL        0x02
+#define BP0        0x04
+#define BP1        0x08
+#define WPEN       0x80
+#define NONVOLATILE_BITS (WPEN | BP1 | BP0)
+#define PAGE_SIZE  CAT25256_PAGE_SIZE
+
+static uint8_t cat25256_sim_busy(const cat25256_sim_t *sim) {
+    return sim->now_ns < sim->busy_until_ns;
+}
+
+static void cat25256_sim_add_energy(cat25256_sim_t *sim, uint64_t nw, uint64_t ns) {
+    // nW times ns are attojoules, the remainder below a picojoule is carried over
+    sim->energy_rest_aj += nw * ns;
+    sim->stats.energy_pj += sim->energy_rest_aj / 1000000u;
+    sim->energy_rest_aj %= 1000000u;
+}
+
+/**
+ * Integrates the background current (standby or write cycle) up to the current time
+ */
+static void cat25256_sim_settle(cat25256_sim_t *sim) {
+    if (sim->now_ns <= sim->energy_ns) {
+        return;
+    }
+    if (!sim->powered_off) {
+        uint64_t mv = sim->energy.supply_mv;
+        uint64_t busy = 0;
+        if (sim->busy_until_ns > sim->energy_ns) {
+            busy = (sim->busy_until_ns < sim->now_ns ? sim->busy_until_ns : sim->now_ns) - sim->energy_ns;
+        }
+        cat25256_sim_add_energy(sim, sim->energy.write_cycle_ua * mv, busy);
+        cat25256_sim_add_energy(sim, sim->energy.standby_na * mv / 1000u, sim->now_ns - sim->energy_ns - busy);
+    }
+    sim->energy_ns = sim->now_ns;
+}
+
+static void cat25256_sim_clock_bytes(cat25256_sim_t *sim, uint32_t length) {
+    uint64_t ns = (uint64_t) length * 8 * 1000000000u / sim->spi_clock_hz;
+    uint64_t ua = sim->energy.active_ua + (uint64_t) sim->energy.active_ua_per_mhz * sim->spi_clock_hz / 1000000u;
+    cat25256_sim_add_energy(sim, ua * sim->energy.supply_mv, ns);
+    sim->now_ns += ns;
+    sim->stats.bus_bytes += length;
+}
+
+static uint8_t cat25256_sim_status(const cat25256_sim_t *sim) {
+    return sim->status | (cat25256_sim_busy(sim) ? NREADY : 0);
+}
+
+static uint32_t cat25256_sim_protected_start(const cat25256_sim_t *sim) {
+    switch ((sim->status & (BP1 | BP0)) >> 2) {
+        case CAT25256_PROTECT_UPPER_QUARTER:
+            return CAT25256_CAPACITY - CAT25256_CAPACITY / 4;
+        case CAT25256_PROTECT_UPPER_HALF:
+            return CAT25256_CAPACITY / 2;
+        case CAT25256_PROTECT_ALL:
+            return 0;
+        default:
+            return CAT25256_CAPACITY;
+    }
+}
+
+static uint64_t cat25256_sim_random(cat25256_sim_t *sim) {
+    uint64_t z = (sim->cut.seed += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static void cat25256_sim_power_off(cat25256_sim_t *sim, uint64_t at_ns) {
+    cat25256_sim_settle(sim);
+    if (at_ns < sim->busy_until_ns) {
+        // The write cycle is interrupted, the programmed bytes end up old, new or anything in between
+        sim->torn = 1;
+        for (uint32_t i = 0; i < PAGE_SIZE; i++) {
+            if (!sim->program_mask[i]) {
+                continue;
+            }
+            uint8_t *byte = &sim->memory[sim->program_base + i];
+            if (sim->cut.torn == CAT25256_TORN_OLD) {
+                *byte = sim->program_old[i];
+            } else if (sim->cut.torn == CAT25256_TORN_MIXED) {
+                uint64_t draw = cat25256_sim_random(sim);
+                *byte = draw % 3 == 0 ? sim->program_old[i] : draw % 3 == 1 ? *byte : (uint8_t) (draw >> 8);
+            }
+        }
+        if (sim->cut.torn == CAT25256_TORN_OLD) {
+            sim->status = (uint8_t) ((sim->status & ~NONVOLATILE_BITS) | (sim->status_old & NONVOLATILE_BITS));
+        }
+    }
+
+    sim->powered_off = 1;
+    sim->cut.trigger = CAT25256_CUT_NONE;
+    sim->selected = 0;
+    sim->held = 0;
+    sim->status &= NONVOLATILE_BITS;
+    sim->busy_until_ns = 0;
+}
+
+static uint8_t cat25256_sim_check_cut(cat25256_sim_t *sim) {
+    if (sim->cut.trigger == CAT25256_CUT_AT_TIME && sim->now_ns >= sim->cut.time_ns) {
+        cat25256_sim_power_off(sim, sim->cut.time_ns);
+    }
+    return sim->powered_off;
+}
+
+static void cat25256_sim_command(cat25256_sim_t *sim, uint8_t byte) {
+    if (sim->count == 0) {
+        sim->opcode = byte;
+        if (cat25256_sim_busy(sim) && byte != RDSR) {
+            // Ignored until the write cycle completes
+            sim->opcode = 0;
+        } else if (byte == WREN) {
+            sim->status |= WEL;
+        } else if (byte == WRDI) {
+            sim->status &= ~WEL;
+        }
+    } else if ((sim->opcode == READ || sim->opcode == WRITE) && sim->count < 3) {
+        sim->address = (uint16_t) ((sim->address << 8) | byte);
+        sim->address %= CAT25256_CAPACITY;
+    } else if (sim->opcode == WRITE) {
+        // The address rolls over within the page
+        uint32_t offset = (sim->address + sim->count - 3) % PAGE_SIZE;
+        sim->page[offset] = byte;
+        sim->page_written[offset] = 1;
+    } else if (sim->opcode == WRSR && sim->count == 1) {
+        sim->page[0] = byte;
+        sim->page_written[0] = 1;
+    }
+    sim->count++;
+}
+
+static memory_status_t cat25256_sim_cs_enable(void *handle, size_t cs) {
+    cat25256_sim_t *sim = handle;
+    (void) cs;
+
+    if (sim->cut.trigger == CAT25256_CUT_AFTER_TRANSACTIONS && sim->total_transactions >= sim->cut.transactions) {
+        cat25256_sim_power_off(sim, sim->now_ns);
+    }
+    if (cat25256_sim_check_cut(sim)) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    sim->selected = 1;
+    sim->held = 0;
+    sim->opcode = 0;
+    sim->count = 0;
+    sim->address = 0;
+    memset(sim->page_written, 0, sizeof sim->page_written);
+    sim->now_ns += CAT25256_SIM_CS_OVERHEAD_NS;
+    sim->stats.transactions++;
+    return MEMORY_STATUS_OK;
+}
+
+static memory_status_t cat25256_sim_cs_disable(void *handle, size_t cs) {
+    cat25256_sim_t *sim = handle;
+    (void) cs;
+
+    if (cat25256_sim_check_cut(sim) || !sim->selected) {
+        return MEMORY_STATUS_NOK;
+    }
+    sim->selected = 0;
+    sim->total_transactions++;
+
+    uint8_t programmed = 0;
+    if (sim->opcode == WRITE && sim->count > 3 && (sim->status & WEL)) {
+        uint32_t base = sim->address - sim->address % PAGE_SIZE;
+        if (base >= cat25256_sim_protected_start(sim)) {
+            // Dropped by the chip, only WEL is reset
+            sim->status &= ~WEL;
+            return MEMORY_STATUS_OK;
+        }
+        sim->program_base = (uint16_t) base;
+        memcpy(sim->program_old, &sim->memory[base], PAGE_SIZE);
+        memcpy(sim->program_mask, sim->page_written, PAGE_SIZE);
+        for (uint32_t i = 0; i < PAGE_SIZE; i++) {
+            if (sim->page_written[i]) {
+                sim->memory[base + i] = sim->page[i];
+            }
+        }
+        sim->stats.page_programs++;
+        programmed = 1;
+    } else if (sim->opcode == WRSR && sim->count > 1 && (sim->status & WEL)) {
+        memset(sim->program_mask, 0, PAGE_SIZE);
+        sim->status_old = sim->status;
+        sim->status = (uint8_t) ((sim->status & ~NONVOLATILE_BITS) | (sim->page[0] & NONVOLATILE_BITS));
+        programmed = 1;
+    }
+
+    if (programmed) {
+        sim->status &= ~WEL;
+        cat25256_sim_settle(sim);
+        sim->busy_until_ns = sim->now_ns + (uint64_t) sim->write_cycle_us * 1000u;
+        sim->total_programs++;
+        if (sim->cut.trigger == CAT25256_CUT_DURING_PROGRAM && sim->total_programs == sim->cut.program) {
+            cat25256_sim_power_off(sim, sim->now_ns);
+        }
+    }
+    return MEMORY_STATUS_OK;
+}
+
+static memory_status_t cat25256_sim_write(void *handle, const uint8_t *data, uint32_t length) {
+    cat25256_sim_t *sim = handle;
+    if (cat25256_sim_check_cut(sim) || !sim->selected || sim->held) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    // A transfer the supply did not survive never reaches the chip
+    cat25256_sim_clock_bytes(sim, length);
+    if (cat25256_sim_check_cut(sim)) {
+        return MEMORY_STATUS_NOK;
+    }
+    for (uint32_t i = 0; i < length; i++) {
+        cat25256_sim_command(sim, data[i]);
+    }
+    return MEMORY_STATUS_OK;
+}
+
+static memory_status_t cat25256_sim_read(void *handle, uint8_t *data, uint32_t length) {
+    cat25256_sim_t *sim = handle;
+    if (cat25256_sim_check_cut(sim) || !sim->selected || sim->held) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    // Data clocked out while the supply fails is garbage, the transfer fails as a whole
+    cat25256_sim_clock_bytes(sim, length);
+    if (cat25256_sim_check_cut(sim)) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    if (sim->opcode == RDSR) {
+        // The status register is repeated as long as the clock runs
+        memset(data, cat25256_sim_status(sim), length);
+        sim->stats.status_polls++;
+    } else if (sim->opcode == READ && sim->count >= 3) {
+        for (uint32_t i = 0; i < length; i++) {
+            data[i] = sim->memory[(sim->address + sim->count - 3 + i) % CAT25256_CAPACITY];
+        }
+        sim->count += length;
+    } else {
+        memset(data, 0xFF, length);
+    }
+    return MEMORY_STATUS_OK;
+}
+
+static memory_status_t cat25256_sim_hold_assert(void *handle, size_t cs) {
+    cat25256_sim_t *sim = handle;
+    (void) cs;
+
+    if (cat25256_sim_check_cut(sim) || !sim->selected || sim->held) {
+        return MEMORY_STATUS_NOK;
+    }
+    sim->held = 1;
+    sim->stats.holds++;
+    return MEMORY_STATUS_OK;
+}
+
+static memory_status_t cat25256_sim_hold_release(void *handle, size_t cs) {
+    cat25256_sim_t *sim = handle;
+    (void) cs;
+
+    if (cat25256_sim_check_cut(sim) || !sim->held) {
+        return MEMORY_STATUS_NOK;
+    }
+    sim->held = 0;
+    return MEMORY_STATUS_OK;
+}
+
+static uint32_t cat25256_sim_get_time_us(void *handle) {
+    const cat25256_sim_t *sim = handle;
+    return (uint32_t) (sim->now_ns / 1000u);
+}
+
+static void cat25256_sim_delay_us(void *handle, uint32_t us) {
+    cat25256_sim_t *sim = handle;
+    sim->now_ns += (uint64_t) us * 1000u;
+    cat25256_sim_check_cut(sim);
+}
+
+void cat25256_sim_init(cat25256_sim_t *sim, uint32_t spi_clock_hz, uint32_t write_cycle_us) {
+    memset(sim, 0, sizeof *sim);
+    memset(sim->memory, 0xFF, sizeof sim->memory);
+    sim->spi_clock_hz = spi_clock_hz != 0 ? spi_clock_hz : CAT25256_DEFAULT_SPI_CLOCK_HZ;
+    sim->write_cycle_us = write_cycle_us != 0 ? write_cycle_us : CAT25256_DEFAULT_WRITE_CYCLE_US;
+    sim->energy.supply_mv = CAT25256_SIM_SUPPLY_MV;
+    sim->energy.standby_na = CAT25256_SIM_STANDBY_NA;
+    sim->energy.active_ua = CAT25256_SIM_ACTIVE_UA;
+    sim->energy.active_ua_per_mhz = CAT25256_SIM_ACTIVE_UA_PER_MHZ;
+    sim->energy.write_cycle_ua = CAT25256_SIM_WRITE_CYCLE_UA;
+}
+
+void cat25256_sim_attach(cat25256_sim_t *sim, cat25256_handle_t *handle) {
+    handle->low_level_handle = sim;
+    handle->read = cat25256_sim_read;
+    handle->write = cat25256_sim_write;
+    handle->cs_enable = cat25256_sim_cs_enable;
+    handle->cs_disable = cat25256_sim_cs_disable;
+    handle->get_time_us = cat25256_sim_get_time_us;
+    handle->delay_us = cat25256_sim_delay_us;
+    handle->hold_assert = cat25256_sim_hold_assert;
+    handle->hold_release = cat25256_sim_hold_release;
+    handle->spi_clock_hz = sim->spi_clock_hz;
+}
+
+uint64_t cat25256_sim_now_ns(const cat25256_sim_t *sim) {
+    return sim->now_ns;
+}
+
+void cat25256_sim_set_cut(cat25256_sim_t *sim, const cat25256_cut_t *cut) {
+    sim->cut = *cut;
+}
+
+void cat25256_sim_power_on(cat25256_sim_t *sim) {
+    // Nothing is drawn while the supply is off
+    cat25256_sim_settle(sim);
+    sim->powered_off = 0;
+    sim->torn = 0;
+    sim->cut.trigger = CAT25256_CUT_NONE;
+}
+
+void cat25256_sim_reset_stats(cat25256_sim_t *sim) {
+    cat25256_sim_settle(sim);
+    memset(&sim->stats, 0, sizeof sim->stats);
+}
+
+uint64_t cat25256_sim_energy_pj(cat25256_sim_t *sim) {
+    cat25256_sim_settle(sim);
+    return sim->stats.energy_pj;
+}
@@ -0,0 +1,202 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAT25256_SIM_H
+#define _CAT25256_SIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cat25256.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef CAT25256_SIM_CS_OVERHEAD_NS
+#define CAT25256_SIM_CS_OVERHEAD_NS 1000
+#endif
+
+/**
+ * Default supply and currents of the energy model, typical figures of a 3.3 V serial EEPROM
+ */
+#ifndef CAT25256_SIM_SUPPLY_MV
+#define CAT25256_SIM_SUPPLY_MV 3300
+#endif
+
+#ifndef CAT25256_SIM_STANDBY_NA
+#define CAT25256_SIM_STANDBY_NA 1000
+#endif
+
+#ifndef CAT25256_SIM_ACTIVE_UA
+#define CAT25256_SIM_ACTIVE_UA 200
+#endif
+
+#ifndef CAT25256_SIM_ACTIVE_UA_PER_MHZ
+#define CAT25256_SIM_ACTIVE_UA_PER_MHZ 130
+#endif
+
+#ifndef CAT25256_SIM_WRITE_CYCLE_UA
+#define CAT25256_SIM_WRITE_CYCLE_UA 1500
+#endif
+
+/**
+ * Energy model: the chip draws standby_na while idle and write_cycle_ua instead during a write cycle.
+ * Clocking the bus adds active_ua plus active_ua_per_mhz for every MHz of the SPI clock for the transfer time.
+ */
+typedef struct {
+    uint32_t supply_mv;
+    uint32_t standby_na;
+    uint32_t active_ua;
+    uint32_t active_ua_per_mhz;
+    uint32_t write_cycle_ua;
+} cat25256_sim_energy_t;
+
+/**
+ * Bus and array activity counted by the simulator
+ */
+typedef struct {
+    uint32_t transactions;
+    uint32_t bus_bytes;
+    uint32_t page_programs;
+    uint32_t status_polls;
+    uint32_t holds;
+    uint64_t energy_pj;
+} cat25256_sim_stats_t;
+
+typedef enum {
+    CAT25256_CUT_NONE = 0,
+    CAT25256_CUT_AFTER_TRANSACTIONS,
+    CAT25256_CUT_AT_TIME,
+    CAT25256_CUT_DURING_PROGRAM
+} cat25256_cut_trigger_t;
+
+/**
+ * What the bytes of a page program look like when power fails during its tWC
+ */
+typedef enum {
+    CAT25256_TORN_OLD = 0,
+    CAT25256_TORN_NEW,
+    CAT25256_TORN_MIXED
+} cat25256_torn_t;
+
+/**
+ * A power cut: once transactions chip select sessions have completed, at time_ns on the virtual clock, or at
+ * the start of the tWC of the program-th page or status register program (counted from 1).
+ * Mixed bytes are drawn from seed.
+ */
+typedef struct {
+    cat25256_cut_trigger_t trigger;
+    uint32_t transactions;
+    uint64_t time_ns;
+    uint32_t program;
+    cat25256_torn_t torn;
+    uint64_t seed;
+} cat25256_cut_t;
+
+/**
+ * A RAM backed CAT25256 on a virtual clock. Every byte on the bus advances the clock by 8 SPI clocks,
+ * every chip select session by CAT25256_SIM_CS_OVERHEAD_NS, delay_us by the requested time.
+ * Programs take write_cycle_us, commands other than RDSR are ignored while the chip is busy.
+ * While HOLD is asserted the chip does not take part in transfers but keeps its command state.
+ * After a power cut every transfer fails until cat25256_sim_power_on, the clock keeps running.
+ * Energy is integrated along the clock with the energy model, which may be changed at any time.
+ */
+typedef struct {
+    uint8_t memory[CAT25256_CAPACITY];
+    uint32_t spi_clock_hz;
+    uint32_t write_cycle_us;
+    uint64_t now_ns;
+    uint64_t busy_until_ns;
+    uint8_t status;
+
+    uint8_t selected;
+    uint8_t held;
+    uint8_t opcode;
+    uint32_t count;
+    uint16_t address;
+    uint8_t page[CAT25256_PAGE_SIZE];
+    uint8_t page_written[CAT25256_PAGE_SIZE];
+
+    uint32_t total_transactions;
+    uint32_t total_programs;
+    uint16_t program_base;
+    uint8_t program_old[CAT25256_PAGE_SIZE];
+    uint8_t program_mask[CAT25256_PAGE_SIZE];
+    uint8_t status_old;
+    cat25256_cut_t cut;
+    uint8_t powered_off;
+    uint8_t torn;
+
+    cat25256_sim_energy_t energy;
+    uint64_t energy_ns;
+    uint64_t energy_rest_aj;
+
+    cat25256_sim_stats_t stats;
+} cat25256_sim_t;
+
+/**
+ * @brief Erases the simulated array to 0xFF and resets the clock, the counters and the energy model.
+ * @param sim The simulator
+ * @param spi_clock_hz The bus clock, 0 selects CAT25256_DEFAULT_SPI_CLOCK_HZ
+ * @param write_cycle_us The program time, 0 selects CAT25256_DEFAULT_WRITE_CYCLE_US
+ */
+void cat25256_sim_init(cat25256_sim_t *sim, uint32_t spi_clock_hz, uint32_t write_cycle_us);
+
+/**
+ * @brief Points all bus and HOLD callbacks of a handle at the simulator.
+ * @param sim The simulator
+ * @param handle The handle, the other members are left untouched
+ */
+void cat25256_sim_attach(cat25256_sim_t *sim, cat25256_handle_t *handle);
+
+/**
+ * @brief Reads the virtual clock.
+ * @param sim The simulator
+ * @return Nanoseconds since cat25256_sim_init
+ */
+uint64_t cat25256_sim_now_ns(const cat25256_sim_t *sim);
+
+/**
+ * @brief Arms a power cut, replacing any armed before.
+ * @param sim The simulator
+ * @param cut The cut, CAT25256_CUT_NONE disarms
+ */
+void cat25256_sim_set_cut(cat25256_sim_t *sim, const cat25256_cut_t *cut);
+
+/**
+ * @brief Restores power after a cut. The array and the non-volatile status bits keep their state.
+ * @param sim The simulator
+ */
+void cat25256_sim_power_on(cat25256_sim_t *sim);
+
+/**
+ * @brief Clears the activity counters.
+ * @param sim The simulator
+ */
+void cat25256_sim_reset_stats(cat25256_sim_t *sim);
+
+/**
+ * @brief Returns the energy drawn since the last reset of the counters, up to the current time.
+ * @param sim The simulator
+ * @return The energy in picojoules, also left in stats.energy_pj
+ */
+uint64_t cat25256_sim_energy_pj(cat25256_sim_t *sim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_CAT25256_SIM_H
@@ -0,0 +1,411 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "cat25256_workload.h"
+
+/*
+ * Forwarders installed on the handle during a run, they count the bus traffic and pass everything on
+ */
+
+static memory_status_t cat25256_workload_read_shim(void *handle, uint8_t *data, uint32_t length) {
+    cat25256_workload_t *workload = handle;
+    workload->bus_bytes += length;
+    return workload->original.read(workload->original.low_level_handle, data, length);
+}
+
+static memory_status_t cat25256_workload_write_shim(void *handle, const uint8_t *data, uint32_t length) {
+    cat25256_workload_t *workload = handle;
+    workload->bus_bytes += length;
+    return workload->original.write(workload->original.low_level_handle, data, length);
+}
+
+static memory_status_t cat25256_workload_cs_enable_shim(void *handle, size_t cs) {
+    cat25256_workload_t *workload = handle;
+    workload->transactions++;
+    return workload->original.cs_enable(workload->original.low_level_handle, cs);
+}
+
+static memory_status_t cat25256_workload_cs_disable_shim(void *handle, size_t cs) {
+    cat25256_workload_t *workload = handle;
+    return workload->original.cs_disable(workload->original.low_level_handle, cs);
+}
+
+static uint32_t cat25256_workload_get_time_us_shim(void *handle) {
+    cat25256_workload_t *workload = handle;
+    return workload->original.get_time_us(workload->original.low_level_handle);
+}
+
+static void cat25256_workload_delay_us_shim(void *handle, uint32_t us) {
+    cat25256_workload_t *workload = handle;
+    workload->original.delay_us(workload->original.low_level_handle, us);
+}
+
+static memory_status_t cat25256_workload_lock_shim(void *handle, size_t cs) {
+    cat25256_workload_t *workload = handle;
+    return workload->original.lock(workload->original.low_level_handle, cs);
+}
+
+static memory_status_t cat25256_workload_unlock_shim(void *handle, size_t cs) {
+    cat25256_workload_t *workload = handle;
+    return workload->original.unlock(workload->original.low_level_handle, cs);
+}
+
+static memory_status_t cat25256_workload_hold_assert_shim(void *handle, size_t cs) {
+    cat25256_workload_t *workload = handle;
+    return workload->original.hold_assert(workload->original.low_level_handle, cs);
+}
+
+static memory_status_t cat25256_workload_hold_release_shim(void *handle, size_t cs) {
+    cat25256_workload_t *workload = handle;
+    return workload->original.hold_release(workload->original.low_level_handle, cs);
+}
+
+static void cat25256_workload_urgent_transfer_shim(void *handle) {
+    cat25256_workload_t *workload = handle;
+    workload->original.urgent_transfer(workload->original.low_level_handle);
+}
+
+static void cat25256_workload_attach(cat25256_workload_t *workload, cat25256_handle_t *handle) {
+    workload->target = handle;
+    workload->original = *handle;
+    workload->bus_bytes = 0;
+    workload->transactions = 0;
+
+    handle->low_level_handle = workload;
+    handle->read = cat25256_workload_read_shim;
+    handle->write = cat25256_workload_write_shim;
+    handle->cs_enable = cat25256_workload_cs_enable_shim;
+    handle->cs_disable = cat25256_workload_cs_disable_shim;
+    handle->get_time_us = handle->get_time_us != NULL ? cat25256_workload_get_time_us_shim : NULL;
+    handle->delay_us = handle->delay_us != NULL ? cat25256_workload_delay_us_shim : NULL;
+    handle->lock = handle->lock != NULL ? cat25256_workload_lock_shim : NULL;
+    handle->unlock = handle->unlock != NULL ? cat25256_workload_unlock_shim : NULL;
+    handle->hold_assert = handle->hold_assert != NULL ? cat25256_workload_hold_assert_shim : NULL;
+    handle->hold_release = handle->hold_release != NULL ? cat25256_workload_hold_release_shim : NULL;
+    handle->urgent_transfer = handle->urgent_transfer != NULL ? cat25256_workload_urgent_transfer_shim : NULL;
+}
+
+static void cat25256_workload_detach(cat25256_workload_t *workload) {
+    // The per-chip state was updated through the handle during the run, keep it
+    cat25256_handle_t *handle = workload->target;
+    memcpy(workload->original.chip, handle->chip, sizeof handle->chip);
+    *handle = workload->original;
+}
+
+/**
+ * splitmix64, small and good enough to make workloads repeatable from a seed
+ */
+static uint64_t cat25256_workload_random(cat25256_workload_t *workload) {
+    uint64_t z = (workload->state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static uint32_t cat25256_workload_uniform(cat25256_workload_t *workload, uint32_t bound) {
+    return bound > 0 ? (uint32_t) (cat25256_workload_random(workload) % bound) : 0;
+}
+
+static uint32_t cat25256_workload_gcd(uint32_t a, uint32_t b) {
+    while (b != 0) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static void cat25256_workload_prepare(cat25256_workload_t *workload, const cat25256_scenario_t *scenario) {
+    workload->state = scenario->seed;
+    workload->slot_size = scenario->slot_size > 0 ? scenario->slot_size : scenario->max_size;
+    while (scenario->region_length / workload->slot_size > CAT25256_WORKLOAD_MAX_SLOTS) {
+        workload->slot_size *= 2;
+    }
+    workload->slots = scenario->region_length / workload->slot_size;
+    if (workload->slots == 0) {
+        workload->slots = 1;
+    }
+
+    // Hot ranks are scattered over the region by a stride coprime to the number of slots
+    workload->stride = (uint32_t) (workload->slots * 0.618) | 1;
+    while (cat25256_workload_gcd(workload->stride, workload->slots) != 1) {
+        workload->stride += 2;
+    }
+
+    double sum = 0;
+    for (uint32_t rank = 0; rank < workload->slots; rank++) {
+        sum += 1.0 / pow(rank + 1, scenario->zipf_exponent);
+        workload->cdf[rank] = sum;
+    }
+    for (uint32_t rank = 0; rank < workload->slots; rank++) {
+        workload->cdf[rank] /= sum;
+    }
+}
+
+static uint32_t cat25256_workload_address(cat25256_workload_t *workload, const cat25256_scenario_t *scenario,
+                                          uint32_t size, uint32_t *cursor) {
+    uint32_t offset;
+    switch (scenario->distribution) {
+        case CAT25256_DISTRIBUTION_ZIPF: {
+            double draw = (double) (cat25256_workload_random(workload) >> 11) / (double) (1ull << 53);
+            uint32_t low = 0;
+            uint32_t high = workload->slots - 1;
+            while (low < high) {
+                uint32_t middle = (low + high) / 2;
+                if (workload->cdf[middle] < draw) {
+                    low = middle + 1;
+                } else {
+                    high = middle;
+                }
+            }
+            uint32_t slot = (uint32_t) (((uint64_t) low * workload->stride) % workload->slots);
+            uint32_t spread = workload->slot_size > size ? workload->slot_size - size + 1 : 1;
+            offset = slot * workload->slot_size + cat25256_workload_uniform(workload, spread);
+            break;
+        }
+        case CAT25256_DISTRIBUTION_SEQUENTIAL:
+            offset = *cursor;
+            *cursor += size;
+            break;
+        default:
+            offset = cat25256_workload_uniform(workload, scenario->region_length - size + 1);
+            break;
+    }
+    if (offset + size > scenario->region_length) {
+        offset = 0;
+        *cursor = size;
+    }
+    return scenario->region_start + offset;
+}
+
+static int cat25256_workload_compare(const void *a, const void *b) {
+    const cat25256_sample_t *x = a;
+    const cat25256_sample_t *y = b;
+    if (x->sample_class != y->sample_class) {
+        return x->sample_class < y->sample_class ? -1 : 1;
+    }
+    return x->latency_us < y->latency_us ? -1 : x->latency_us > y->latency_us;
+}
+
+static void cat25256_workload_percentiles(cat25256_workload_t *workload, size_t count,
+                                          cat25256_workload_result_t *result) {
+    qsort(workload->samples, count, sizeof workload->samples[0], cat25256_workload_compare);
+    size_t first = 0;
+    while (first < count) {
+        size_t last = first;
+        while (last < count && workload->samples[last].sample_class == workload->samples[first].sample_class) {
+            last++;
+        }
+        cat25256_latency_t *latency = &result->latency[workload->samples[first].sample_class];
+        const cat25256_sample_t *samples = &workload->samples[first];
+        size_t n = last - first;
+        latency->count = (uint32_t) n;
+        latency->p50_us = samples[(n - 1) * 50 / 100].latency_us;
+        latency->p90_us = samples[(n - 1) * 90 / 100].latency_us;
+        latency->p99_us = samples[(n - 1) * 99 / 100].latency_us;
+        latency->max_us = samples[n - 1].latency_us;
+        first = last;
+    }
+}
+
+memory_status_t
+cat25256_workload_run(cat25256_workload_t *workload, cat25256_handle_t *handle, size_t cs,
+                      const cat25256_scenario_t *scenario, cat25256_workload_result_t *result) {
+    if (workload == NULL || handle == NULL || scenario == NULL || result == NULL || cs >= CAT25256_MAX_CS) {
+        return MEMORY_STATUS_NOK;
+    }
+    if (handle->read == NULL || handle->write == NULL || handle->cs_enable == NULL || handle->cs_disable == NULL) {
+        return MEMORY_STATUS_INVALID_HANDLE;
+    }
+    if (scenario->region_length == 0 || scenario->region_length > CAT25256_CAPACITY ||
+        scenario->region_start > CAT25256_CAPACITY - scenario->region_length || scenario->min_size == 0 || scenario->min_size > scenario->max_size ||
+        scenario->max_size > scenario->region_length || scenario->read_percent > 100) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    memset(result, 0, sizeof *result);
+    cat25256_workload_prepare(workload, scenario);
+    cat25256_workload_attach(workload, handle);
+    uint8_t timed = handle->get_time_us != NULL;
+    uint32_t programs = handle->chip[cs].programs;
+    uint32_t started = timed ? handle->get_time_us(handle->low_level_handle) : 0;
+    uint32_t cursor = 0;
+    size_t sampled = 0;
+
+    uint32_t op = 0;
+    while (op < scenario->operations) {
+        uint8_t sample_class;
+        uint32_t count = 1;
+        uint32_t idle = scenario->think_time_us;
+        if (scenario->full_read_interval > 0 && op > 0 && op % scenario->full_read_interval == 0) {
+            sample_class = CAT25256_SAMPLE_FULL_READ;
+        } else if (cat25256_workload_uniform(workload, 100) < scenario->read_percent) {
+            sample_class = CAT25256_SAMPLE_READ;
+        } else {
+            sample_class = CAT25256_SAMPLE_WRITE;
+            count = scenario->burst_length > 0 ? scenario->burst_length : 1;
+            idle += scenario->burst_gap_us;
+        }
+
+        for (uint32_t i = 0; i < count && op < scenario->operations; i++, op++) {
+            uint32_t size = scenario->min_size +
+                            cat25256_workload_uniform(workload, scenario->max_size - scenario->min_size + 1);
+            uint32_t address;
+            if (sample_class == CAT25256_SAMPLE_FULL_READ) {
+                address = scenario->region_start;
+                size = scenario->region_length;
+            } else {
+                address = cat25256_workload_address(workload, scenario, size, &cursor);
+            }
+
+            uint32_t start = timed ? handle->get_time_us(handle->low_level_handle) : 0;
+            memory_status_t rc;
+            if (sample_class == CAT25256_SAMPLE_WRITE) {
+                for (uint32_t b = 0; b < size; b++) {
+                    workload->data[b] = (uint8_t) cat25256_workload_random(workload);
+                }
+                rc = cat25256_write(handle, address, workload->data, size, cs);
+            } else {
+                rc = cat25256_read(handle, address, workload->data, size, cs);
+            }
+            uint32_t latency = timed ? handle->get_time_us(handle->low_level_handle) - start : 0;
+
+            result->operations++;
+            result->busy_us += latency;
+            if (rc != MEMORY_STATUS_OK) {
+                result->errors++;
+            }
+            if (sampled < workload->capacity && workload->samples != NULL) {
+                workload->samples[sampled].latency_us = latency;
+                workload->samples[sampled].sample_class = sample_class;
+                sampled++;
+            }
+        }
+
+        if (idle > 0 && handle->delay_us != NULL) {
+            handle->delay_us(handle->low_level_handle, idle);
+        }
+    }
+
+    result->elapsed_us = timed ? handle->get_time_us(handle->low_level_handle) - started : 0;
+    result->page_programs = handle->chip[cs].programs - programs;
+    result->bus_bytes = workload->bus_bytes;
+    result->transactions = workload->transactions;
+    result->ops_per_s = result->elapsed_us > 0 ? result->operations * 1e6 / (double) result->elapsed_us : 0;
+    cat25256_workload_detach(workload);
+
+    cat25256_workload_percentiles(workload, sampled, result);
+    return MEMORY_STATUS_OK;
+}
+
+static void cat25256_workload_defaults(cat25256_scenario_t *scenario) {
+    memset(scenario, 0, sizeof *scenario);
+    strcpy(scenario->name, "default");
+    scenario->seed = 1;
+    scenario->operations = 1000;
+    scenario->region_length = CAT25256_CAPACITY;
+    scenario->read_percent = 50;
+    scenario->zipf_exponent = 1.0;
+    scenario->min_size = 1;
+    scenario->max_size = 16;
+    scenario->burst_length = 1;
+}
+
+memory_status_t cat25256_workload_load(const char *path, cat25256_scenario_t *scenario) {
+    if (path == NULL || scenario == NULL) {
+        return MEMORY_STATUS_NOK;
+    }
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return MEMORY_STATUS_NOK;
+    }
+    cat25256_workload_defaults(scenario);
+
+    char line[128];
+    memory_status_t rc = MEMORY_STATUS_OK;
+    while (rc == MEMORY_STATUS_OK && fgets(line, sizeof line, file) != NULL) {
+        char *comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        char key[32];
+        char value[64];
+        if (sscanf(line, " %31[a-z_] = %63s", key, value) != 2) {
+            // Blank and comment lines
+            char rest[2];
+            rc = sscanf(line, " %1s", rest) == 1 ? MEMORY_STATUS_NOK : MEMORY_STATUS_OK;
+            continue;
+        }
+
+        unsigned long long number = strtoull(value, NULL, 0);
+        if (strcmp(key, "name") == 0) {
+            snprintf(scenario->name, sizeof scenario->name, "%.*s", (int) sizeof scenario->name - 1, value);
+        } else if (strcmp(key, "seed") == 0) {
+            scenario->seed = number;
+        } else if (strcmp(key, "operations") == 0) {
+            scenario->operations = (uint32_t) number;
+        } else if (strcmp(key, "region_start") == 0) {
+            scenario->region_start = (uint32_t) number;
+        } else if (strcmp(key, "region_length") == 0) {
+            scenario->region_length = (uint32_t) number;
+        } else if (strcmp(key, "read_percent") == 0) {
+            // Checked before the narrowing, 356 must not turn into 100
+            if (number > 100) {
+                rc = MEMORY_STATUS_NOK;
+            }
+            scenario->read_percent = (uint8_t) number;
+        } else if (strcmp(key, "distribution") == 0) {
+            if (strcmp(value, "uniform") == 0) {
+                scenario->distribution = CAT25256_DISTRIBUTION_UNIFORM;
+            } else if (strcmp(value, "zipf") == 0) {
+                scenario->distribution = CAT25256_DISTRIBUTION_ZIPF;
+            } else if (strcmp(value, "sequential") == 0) {
+                scenario->distribution = CAT25256_DISTRIBUTION_SEQUENTIAL;
+            } else {
+                rc = MEMORY_STATUS_NOK;
+            }
+        } else if (strcmp(key, "zipf_exponent") == 0) {
+            scenario->zipf_exponent = strtod(value, NULL);
+        } else if (strcmp(key, "slot_size") == 0) {
+            scenario->slot_size = (uint32_t) number;
+        } else if (strcmp(key, "min_size") == 0) {
+            scenario->min_size = (uint32_t) number;
+        } else if (strcmp(key, "max_size") == 0) {
+            scenario->max_size = (uint32_t) number;
+        } else if (strcmp(key, "burst_length") == 0) {
+            scenario->burst_length = (uint32_t) number;
+        } else if (strcmp(key, "burst_gap_us") == 0) {
+            scenario->burst_gap_us = (uint32_t) number;
+        } else if (strcmp(key, "think_time_us") == 0) {
+            scenario->think_time_us = (uint32_t) number;
+        } else if (strcmp(key, "full_read_interval") == 0) {
+            scenario->full_read_interval = (uint32_t) number;
+        } else {
+            rc = MEMORY_STATUS_NOK;
+        }
+    }
+    fclose(file);
+
+    if (rc == MEMORY_STATUS_OK && (scenario->region_length > CAT25256_CAPACITY ||
+                                   scenario->region_start > CAT25256_CAPACITY - scenario->region_length)) {
+        rc = MEMORY_STATUS_NOK;
+    }
+    return rc;
+}
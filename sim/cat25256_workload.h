@@ -0,0 +1,145 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CAT25256_WORKLOAD_H
+#define _CAT25256_WORKLOAD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cat25256.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Number of hot spots a Zipf distribution ranks, larger regions get coarser slots
+ */
+#ifndef CAT25256_WORKLOAD_MAX_SLOTS
+#define CAT25256_WORKLOAD_MAX_SLOTS 4096
+#endif
+
+typedef enum {
+    CAT25256_DISTRIBUTION_UNIFORM = 0,
+    CAT25256_DISTRIBUTION_ZIPF,
+    CAT25256_DISTRIBUTION_SEQUENTIAL
+} cat25256_distribution_t;
+
+/**
+ * A repeatable workload, see cat25256_workload_load for the file format
+ * Each operation is a read with read_percent probability, otherwise a burst of burst_length writes followed by
+ * burst_gap_us of idle time. Every full_read_interval operations the whole region is read.
+ */
+typedef struct {
+    char name[32];
+    uint64_t seed;
+    uint32_t operations;
+    uint32_t region_start;
+    uint32_t region_length;
+    uint8_t read_percent;
+    cat25256_distribution_t distribution;
+    double zipf_exponent;
+    uint32_t slot_size;
+    uint32_t min_size;
+    uint32_t max_size;
+    uint32_t burst_length;
+    uint32_t burst_gap_us;
+    uint32_t think_time_us;
+    uint32_t full_read_interval;
+} cat25256_scenario_t;
+
+typedef enum {
+    CAT25256_SAMPLE_READ = 0,
+    CAT25256_SAMPLE_WRITE,
+    CAT25256_SAMPLE_FULL_READ
+} cat25256_sample_class_t;
+
+typedef struct {
+    uint32_t latency_us;
+    uint8_t sample_class;
+} cat25256_sample_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t p50_us;
+    uint32_t p90_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+} cat25256_latency_t;
+
+typedef struct {
+    uint32_t operations;
+    uint32_t errors;
+    uint64_t elapsed_us;
+    uint64_t busy_us;
+    double ops_per_s;
+    uint32_t page_programs;
+    uint32_t bus_bytes;
+    uint32_t transactions;
+    cat25256_latency_t latency[3];
+} cat25256_workload_result_t;
+
+/**
+ * Runner state, large enough for a full region read and the Zipf table, keep it static
+ * samples (capacity entries) records the latencies, operations beyond it are not part of the percentiles.
+ */
+typedef struct {
+    cat25256_sample_t *samples;
+    size_t capacity;
+
+    uint64_t state;
+    uint32_t slots;
+    uint32_t slot_size;
+    uint32_t stride;
+    double cdf[CAT25256_WORKLOAD_MAX_SLOTS];
+    uint8_t data[CAT25256_CAPACITY];
+
+    cat25256_handle_t *target;
+    cat25256_handle_t original;
+    uint32_t bus_bytes;
+    uint32_t transactions;
+} cat25256_workload_t;
+
+/**
+ * @brief Reads a scenario from a file of "key = value" lines, # starts a comment.
+ * Keys are the member names of cat25256_scenario_t, distribution is uniform, zipf or sequential.
+ * @param path The file
+ * @param scenario The scenario, members not in the file get defaults
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on a missing file, an unknown key, a read_percent above
+ * 100 or a region that does not end within the device
+ */
+memory_status_t cat25256_workload_load(const char *path, cat25256_scenario_t *scenario);
+
+/**
+ * @brief Runs a scenario against a handle.
+ * Bus traffic is counted by wrapping the callbacks of the handle for the duration of the run. Latencies and
+ * throughput need get_time_us, idle times need delay_us.
+ * @param workload The runner
+ * @param handle The handle, a simulator or real hardware
+ * @param cs The chip select
+ * @param scenario The scenario
+ * @param result The metrics
+ * @return MEMORY_STATUS_OK on success, MEMORY_STATUS_NOK on an invalid scenario
+ */
+memory_status_t
+cat25256_workload_run(cat25256_workload_t *workload, cat25256_handle_t *handle, size_t cs,
+                      const cat25256_scenario_t *scenario, cat25256_workload_result_t *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //_CAT25256_WORKLOAD_H
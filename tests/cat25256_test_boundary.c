@@ -0,0 +1,108 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Sweeps reads, writes and page writes across the end of the device on the simulator, for the default and a
+ * reduced capacity, in reject and in wrap mode, and compares the array against a model.
+ */
+
+#include <string.h>
+#include "cat25256.h"
+#include "cat25256_sim.h"
+#include "cat25256_test.h"
+
+#define MAX_LENGTH 130
+
+static cat25256_sim_t sim;
+static uint8_t model[CAT25256_CAPACITY];
+
+static const uint32_t lengths[] = {1, 2, 63, 64, 65, MAX_LENGTH};
+
+static void fill(uint8_t *data, uint32_t length, uint32_t seed) {
+    for (uint32_t i = 0; i < length; i++) {
+        data[i] = (uint8_t) (seed * 31 + i * 7 + 1);
+    }
+}
+
+static void check_access(cat25256_handle_t *handle, uint32_t address, uint32_t length, uint32_t seed) {
+    uint32_t capacity = handle->capacity != 0 ? handle->capacity : CAT25256_CAPACITY;
+    uint8_t fits = address < capacity && length <= capacity - address;
+    uint8_t accepted = fits || handle->wrap == CAT25256_WRAP_AROUND;
+    uint8_t data[MAX_LENGTH];
+    uint8_t back[MAX_LENGTH];
+
+    fill(data, length, seed);
+    memory_status_t rc = cat25256_write(handle, address, data, length, 0);
+    CHECK(rc == (accepted ? MEMORY_STATUS_OK : MEMORY_STATUS_OUT_OF_RANGE));
+    if (accepted) {
+        for (uint32_t i = 0; i < length; i++) {
+            model[(address + i) % capacity] = data[i];
+        }
+    }
+    // Rejected writes leave the array untouched, wrapped ones never reach beyond the capacity
+    CHECK(memcmp(sim.memory, model, sizeof model) == 0);
+
+    memset(back, 0, sizeof back);
+    rc = cat25256_read(handle, address, back, length, 0);
+    CHECK(rc == (accepted ? MEMORY_STATUS_OK : MEMORY_STATUS_OUT_OF_RANGE));
+    for (uint32_t i = 0; accepted && i < length; i++) {
+        CHECK(back[i] == model[(address + i) % capacity]);
+    }
+
+    // A single page write never crosses a page, only addresses beyond the capacity are moved
+    uint32_t page_length = CAT25256_PAGE_SIZE - address % CAT25256_PAGE_SIZE;
+    page_length = page_length < length ? page_length : length;
+    fits = address < capacity;
+    fill(data, page_length, seed + 1);
+    rc = cat25256_write_page(handle, address, data, page_length, 0);
+    CHECK(rc == (fits || handle->wrap == CAT25256_WRAP_AROUND ? MEMORY_STATUS_OK : MEMORY_STATUS_OUT_OF_RANGE));
+    if (rc == MEMORY_STATUS_OK) {
+        memcpy(&model[address % capacity], data, page_length);
+    }
+    CHECK(memcmp(sim.memory, model, sizeof model) == 0);
+}
+
+int main(void) {
+    static const uint32_t capacities[] = {0, CAT25256_CAPACITY / 2};
+    uint32_t seed = 0;
+
+    for (size_t c = 0; c < sizeof capacities / sizeof capacities[0]; c++) {
+        for (int wrap = 0; wrap < 2; wrap++) {
+            cat25256_sim_init(&sim, 0, 0);
+            memset(model, 0xFF, sizeof model);
+            cat25256_handle_t handle = {0};
+            cat25256_sim_attach(&sim, &handle);
+            handle.capacity = capacities[c];
+            handle.wrap = wrap ? CAT25256_WRAP_AROUND : CAT25256_WRAP_REJECT;
+
+            uint32_t capacity = capacities[c] != 0 ? capacities[c] : CAT25256_CAPACITY;
+            for (uint32_t address = capacity - MAX_LENGTH - 2; address <= capacity + 2; address++) {
+                for (size_t l = 0; l < sizeof lengths / sizeof lengths[0]; l++) {
+                    check_access(&handle, address, lengths[l], seed++);
+                }
+            }
+
+            // Longer than the device is rejected in both modes, exactly the device is accepted
+            static uint8_t whole[CAT25256_CAPACITY + 1];
+            CHECK(cat25256_read(&handle, 1, whole, capacity + 1, 0) == MEMORY_STATUS_OUT_OF_RANGE);
+            CHECK(cat25256_read(&handle, 1, whole, capacity, 0) ==
+                  (wrap ? MEMORY_STATUS_OK : MEMORY_STATUS_OUT_OF_RANGE));
+            CHECK(cat25256_read(&handle, 0, whole, capacity, 0) == MEMORY_STATUS_OK);
+            CHECK(memcmp(whole, model, capacity) == 0);
+        }
+    }
+    return TEST_RESULT();
+}
@@ -0,0 +1,95 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Bounded writes on the simulator, with and without a time base on the handle: no call may take longer than its
+ * time budget, and the write has to complete with the right data
+ */
+
+#include <string.h>
+#include "cat25256.h"
+#include "cat25256_bounded.h"
+#include "cat25256_sim.h"
+#include "cat25256_test.h"
+
+#define WRITE_ADDRESS 0x1010
+#define WRITE_LENGTH 1000
+#define MAX_CALLS 100000
+
+static cat25256_sim_t sim;
+static uint8_t data[WRITE_LENGTH];
+
+static void check_budget(uint8_t measured, uint32_t time_us) {
+    cat25256_sim_init(&sim, 0, 0);
+    cat25256_handle_t handle = {0};
+    cat25256_sim_attach(&sim, &handle);
+    handle.write_cycle_us = sim.write_cycle_us;
+    if (!measured) {
+        handle.get_time_us = NULL;
+        handle.delay_us = NULL;
+    }
+
+    for (uint32_t i = 0; i < sizeof data; i++) {
+        data[i] = (uint8_t) (i * 13 + time_us);
+    }
+    cat25256_write_token_t token;
+    CHECK(cat25256_write_bounded_begin(&token, WRITE_ADDRESS, data, sizeof data) == MEMORY_STATUS_OK);
+    const cat25256_budget_t budget = {.time_us = time_us};
+
+    uint32_t calls = 0;
+    uint64_t longest_ns = 0;
+    while ((token.remaining > 0 || token.in_flight > 0) && calls < MAX_CALLS) {
+        uint64_t start = cat25256_sim_now_ns(&sim);
+        memory_status_t rc = cat25256_write_bounded(&handle, &token, &budget, 0);
+        CHECK(rc == MEMORY_STATUS_OK);
+        if (rc != MEMORY_STATUS_OK) {
+            fprintf(stderr, "  %s, budget %lu us: failed with %d\n", measured ? "time base" : "no time base",
+                    (unsigned long) time_us, rc);
+            return;
+        }
+        uint64_t elapsed = cat25256_sim_now_ns(&sim) - start;
+        longest_ns = elapsed > longest_ns ? elapsed : longest_ns;
+        calls++;
+    }
+
+    CHECK(token.remaining == 0);
+    CHECK(longest_ns <= (uint64_t) time_us * 1000);
+    CHECK(memcmp(&sim.memory[WRITE_ADDRESS], data, sizeof data) == 0);
+    if (longest_ns > (uint64_t) time_us * 1000) {
+        fprintf(stderr, "  %s, budget %lu us: a call took %.1f us\n", measured ? "time base" : "no time base",
+                (unsigned long) time_us, longest_ns / 1000.0);
+    }
+}
+
+int main(void) {
+    static const uint32_t budgets[] = {10000, 6000, 4000, 2000, 1000, 700};
+
+    for (int measured = 0; measured < 2; measured++) {
+        for (size_t b = 0; b < sizeof budgets / sizeof budgets[0]; b++) {
+            check_budget((uint8_t) measured, budgets[b]);
+        }
+    }
+
+    // A budget below the transfer of one page can never make progress
+    cat25256_sim_init(&sim, 0, 0);
+    cat25256_handle_t handle = {0};
+    cat25256_sim_attach(&sim, &handle);
+    cat25256_write_token_t token;
+    const cat25256_budget_t tiny = {.time_us = 10};
+    CHECK(cat25256_write_bounded_begin(&token, WRITE_ADDRESS, data, sizeof data) == MEMORY_STATUS_OK);
+    CHECK(cat25256_write_bounded(&handle, &token, &tiny, 0) == MEMORY_STATUS_NOK);
+    return TEST_RESULT();
+}
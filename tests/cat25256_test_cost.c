@@ -0,0 +1,191 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Runs reads and writes on the simulator and compares what happened on the bus against the cost model.
+ * Bus traffic outside the write cycles has to match exactly, status polls within one per program. The predicted
+ * time is an upper bound by at most the WRDI and one poll per program.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "cat25256.h"
+#include "cat25256_cost.h"
+#include "cat25256_sim.h"
+#include "cat25256_test.h"
+
+#define REGISTER_SIZE 2
+
+static cat25256_sim_t sim;
+static cat25256_handle_t handle;
+static uint8_t data[3 * CAT25256_PAGE_SIZE];
+static uint32_t poll_us;
+static uint32_t latch_us;
+
+static uint32_t difference(uint32_t a, uint32_t b) {
+    return a > b ? a - b : b - a;
+}
+
+static void setup(uint32_t capacity, cat25256_wrap_t wrap) {
+    cat25256_sim_init(&sim, 0, 0);
+    memset(&handle, 0, sizeof handle);
+    cat25256_sim_attach(&sim, &handle);
+    // Busy polling, the adaptive wait depends on what it learned before
+    handle.get_time_us = NULL;
+    handle.delay_us = NULL;
+    handle.write_cycle_us = sim.write_cycle_us;
+    handle.capacity = capacity;
+    handle.wrap = wrap;
+    poll_us = (uint32_t) ((REGISTER_SIZE * 8ull * 1000000 + sim.spi_clock_hz - 1) / sim.spi_clock_hz) + 1;
+    latch_us = (uint32_t) ((8ull * 1000000 + sim.spi_clock_hz - 1) / sim.spi_clock_hz) + 1;
+}
+
+static void compare(const cat25256_cost_t *cost, uint64_t start_ns) {
+    uint32_t time_us = (uint32_t) ((cat25256_sim_now_ns(&sim) - start_ns + 999) / 1000);
+    uint32_t programs = sim.stats.page_programs;
+
+    CHECK(cost->page_programs == programs);
+    CHECK(difference(cost->transactions, sim.stats.transactions) <= programs);
+    CHECK(difference(cost->bus_bytes, sim.stats.bus_bytes) <= programs * REGISTER_SIZE);
+    // The model rounds the bus time of every page and of every read up to a whole microsecond
+    CHECK(cost->time_us + programs + 2 >= time_us);
+    // Per program it charges the WRDI and a full final poll on top of tWC, the chip may finish earlier in both
+    CHECK(cost->time_us <= time_us + programs * (poll_us + latch_us) + 2);
+    if (programs == 0) {
+        CHECK(cost->transactions == sim.stats.transactions);
+        CHECK(cost->bus_bytes == sim.stats.bus_bytes);
+    }
+}
+
+static void check_read(uint32_t address, uint32_t length) {
+    cat25256_cost_t cost;
+    memory_status_t expected = cat25256_estimate_read(&handle, address, length, &cost, 0);
+
+    cat25256_sim_reset_stats(&sim);
+    uint64_t start = cat25256_sim_now_ns(&sim);
+    CHECK(cat25256_read(&handle, address, data, length, 0) == expected);
+    if (expected == MEMORY_STATUS_OK) {
+        compare(&cost, start);
+    }
+}
+
+static void check_write(uint32_t address, uint32_t length) {
+    cat25256_cost_t cost;
+    memory_status_t expected = cat25256_estimate_write(&handle, address, length, &cost, 0);
+
+    cat25256_sim_reset_stats(&sim);
+    uint64_t start = cat25256_sim_now_ns(&sim);
+    CHECK(cat25256_write(&handle, address, data, length, 0) == expected);
+    if (expected == MEMORY_STATUS_OK) {
+        compare(&cost, start);
+    }
+}
+
+static void check_write_page(uint32_t address, uint32_t length) {
+    cat25256_cost_t cost;
+    memory_status_t expected = cat25256_estimate_write_page(&handle, address, length, &cost, 0);
+
+    cat25256_sim_reset_stats(&sim);
+    uint64_t start = cat25256_sim_now_ns(&sim);
+    CHECK(cat25256_write_page(&handle, address, data, length, 0) == expected);
+    if (expected == MEMORY_STATUS_OK) {
+        compare(&cost, start);
+    }
+}
+
+static void check_batch(void) {
+    static const cat25256_segment_t segments[] = {{0x0100, 10}, {0x0130, 40}, {0x0200, 130}};
+    cat25256_cost_t cost;
+    CHECK(cat25256_estimate_write_batch(&handle, segments, 3, &cost, 0) == MEMORY_STATUS_OK);
+
+    cat25256_sim_reset_stats(&sim);
+    uint64_t start = cat25256_sim_now_ns(&sim);
+    for (size_t i = 0; i < 3; i++) {
+        CHECK(cat25256_write(&handle, segments[i].address, data, segments[i].length, 0) == MEMORY_STATUS_OK);
+    }
+    compare(&cost, start);
+}
+
+/**
+ * The status register read of the protection check is the only difference between a cold and a warm write
+ */
+static void check_protection_read(uint32_t address, uint32_t length) {
+    cat25256_cost_t cold, warm;
+    uint32_t cold_transactions, cold_bytes;
+
+    handle.chip[0].status_valid = 0;
+    CHECK(cat25256_estimate_write(&handle, address, length, &cold, 0) == MEMORY_STATUS_OK);
+    cat25256_sim_reset_stats(&sim);
+    CHECK(cat25256_write(&handle, address, data, length, 0) == MEMORY_STATUS_OK);
+    cold_transactions = sim.stats.transactions;
+    cold_bytes = sim.stats.bus_bytes;
+
+    CHECK(cat25256_estimate_write(&handle, address, length, &warm, 0) == MEMORY_STATUS_OK);
+    cat25256_sim_reset_stats(&sim);
+    CHECK(cat25256_write(&handle, address, data, length, 0) == MEMORY_STATUS_OK);
+
+#if CAT25256_FEATURE_PROTECTION_CHECK
+    CHECK(cold.transactions == warm.transactions + 1);
+    CHECK(cold.bus_bytes == warm.bus_bytes + REGISTER_SIZE);
+    CHECK(cold_transactions == sim.stats.transactions + 1);
+    CHECK(cold_bytes == sim.stats.bus_bytes + REGISTER_SIZE);
+#else
+    CHECK(cold.transactions == warm.transactions);
+    CHECK(cold_transactions == sim.stats.transactions);
+    CHECK(cold_bytes == sim.stats.bus_bytes);
+#endif
+}
+
+int main(void) {
+    static const uint32_t lengths[] = {0, 1, 16, 64, 65, 100, 3 * CAT25256_PAGE_SIZE};
+    static const uint32_t offsets[] = {0, 1, 40, 63};
+
+    for (int wrap = 0; wrap < 2; wrap++) {
+        setup(0, wrap ? CAT25256_WRAP_AROUND : CAT25256_WRAP_REJECT);
+        for (size_t i = 0; i < sizeof data; i++) {
+            data[i] = (uint8_t) rand();
+        }
+
+        for (size_t l = 0; l < sizeof lengths / sizeof lengths[0]; l++) {
+            for (size_t o = 0; o < sizeof offsets / sizeof offsets[0]; o++) {
+                uint32_t length = lengths[l];
+                check_read(0x1000 + offsets[o], length);
+                check_write(0x1000 + offsets[o], length);
+                // Across the end of the device, split in wrap mode
+                check_read(CAT25256_CAPACITY - 1 - offsets[o], length);
+                check_write(CAT25256_CAPACITY - 1 - offsets[o], length);
+                check_write(CAT25256_CAPACITY + offsets[o], length);
+            }
+        }
+        check_write_page(0x2010, 48);
+        check_write_page(CAT25256_CAPACITY + 0x40, 64);
+        check_batch();
+
+        check_protection_read(0x3000, 10);
+        check_protection_read(0x3020, 130);
+        if (wrap) {
+            check_protection_read(CAT25256_CAPACITY - 8, 16);
+        }
+    }
+
+    // A reduced capacity wraps at its own end
+    setup(CAT25256_CAPACITY / 2, CAT25256_WRAP_AROUND);
+    check_read(CAT25256_CAPACITY / 2 - 6, 20);
+    check_write(CAT25256_CAPACITY / 2 - 6, 20);
+    check_write(CAT25256_CAPACITY / 2 - 60, 100);
+    check_write(CAT25256_CAPACITY / 2 + 10, 100);
+    return TEST_RESULT();
+}
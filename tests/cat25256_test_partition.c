@@ -0,0 +1,83 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Write-back partitions on the simulator: every write reaches the device after a flush, also when a full page
+ * write claims a slot whose stale bytes happen to equal the new data. Layouts beyond the capacity are rejected.
+ */
+
+#include <string.h>
+#include "cat25256.h"
+#include "cat25256_partition.h"
+#include "cat25256_sim.h"
+#include "cat25256_test.h"
+
+#define PART_STATE 1
+#define STATE_START 0x0400
+
+static cat25256_sim_t sim;
+
+int main(void) {
+    static const cat25256_partition_entry_t layout[] = {
+            {.id = PART_STATE, .policy = CAT25256_POLICY_WRITE_BACK, .start = STATE_START, .size = 0x0400},
+    };
+    static cat25256_cache_slot_t slots[1];
+    uint8_t zeros[CAT25256_PAGE_SIZE] = {0};
+    uint8_t pattern[CAT25256_PAGE_SIZE];
+    for (uint32_t i = 0; i < sizeof pattern; i++) {
+        pattern[i] = (uint8_t) (i * 5 + 3);
+    }
+
+    cat25256_sim_init(&sim, 0, 0);
+    cat25256_handle_t handle = {0};
+    cat25256_sim_attach(&sim, &handle);
+    cat25256_partition_table_t table = {.handle = &handle, .cs = 0, .table_address = 0x0000};
+    CHECK(cat25256_partition_format(&table, layout, 1) == MEMORY_STATUS_OK);
+    CHECK(cat25256_partition_attach_cache(&table, PART_STATE, slots, 1) == MEMORY_STATUS_OK);
+
+    // A zero filled page equals the zeroed bytes of a fresh slot
+    CHECK(cat25256_partition_write(&table, PART_STATE, 0, zeros, sizeof zeros) == MEMORY_STATUS_OK);
+    CHECK(cat25256_partition_flush(&table) == MEMORY_STATUS_OK);
+    CHECK(memcmp(&sim.memory[STATE_START], zeros, sizeof zeros) == 0);
+
+    // The second page evicts the first, the third equals the bytes the evicted second page left in the slot
+    CHECK(cat25256_partition_write(&table, PART_STATE, CAT25256_PAGE_SIZE, pattern, sizeof pattern) ==
+          MEMORY_STATUS_OK);
+    CHECK(cat25256_partition_write(&table, PART_STATE, 2 * CAT25256_PAGE_SIZE, pattern, sizeof pattern) ==
+          MEMORY_STATUS_OK);
+    CHECK(cat25256_partition_flush(&table) == MEMORY_STATUS_OK);
+    CHECK(memcmp(&sim.memory[STATE_START + CAT25256_PAGE_SIZE], pattern, sizeof pattern) == 0);
+    CHECK(memcmp(&sim.memory[STATE_START + 2 * CAT25256_PAGE_SIZE], pattern, sizeof pattern) == 0);
+
+    // A partial write still reads the page first and skips unchanged bytes
+    cat25256_sim_reset_stats(&sim);
+    CHECK(cat25256_partition_write(&table, PART_STATE, 3 * CAT25256_PAGE_SIZE, pattern, 8) == MEMORY_STATUS_OK);
+    CHECK(cat25256_partition_flush(&table) == MEMORY_STATUS_OK);
+    CHECK(sim.stats.page_programs == 1);
+    CHECK(memcmp(&sim.memory[STATE_START + 3 * CAT25256_PAGE_SIZE], pattern, 8) == 0);
+    CHECK(sim.memory[STATE_START + 3 * CAT25256_PAGE_SIZE + 8] == 0xFF);
+
+    // A partition past the configured capacity is rejected by format, and by mount of a table written before
+    static const cat25256_partition_entry_t beyond[] = {
+            {.id = PART_STATE, .policy = CAT25256_POLICY_WRITE_BACK, .start = 0x3C00, .size = 0x0800},
+    };
+    CHECK(cat25256_partition_format(&table, beyond, 1) == MEMORY_STATUS_OK);
+    handle.capacity = CAT25256_CAPACITY / 8;
+    CHECK(cat25256_partition_mount(&table) == MEMORY_STATUS_NOK);
+    CHECK(cat25256_partition_format(&table, beyond, 1) == MEMORY_STATUS_NOK);
+    CHECK(cat25256_partition_format(&table, layout, 1) == MEMORY_STATUS_OK);
+    return TEST_RESULT();
+}
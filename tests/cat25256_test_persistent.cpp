@@ -0,0 +1,96 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Builds the C++ header with a pre-C++20 standard and checks the persistent variable against the simulator
+ */
+
+#include <cstring>
+#include "cat25256_persistent.hpp"
+#include "cat25256_sim.h"
+#include "cat25256_test.h"
+
+namespace {
+    struct calibration {
+        uint32_t offset;
+        float gain;
+        uint8_t serial[16];
+    };
+
+    struct state {
+        uint32_t boot_count;
+        uint16_t flags;
+        uint8_t mode;
+        uint8_t padding[61];
+        uint32_t checksum;
+    };
+
+    using calibration_t = cat25256::persistent<calibration, 0x0000>;
+    using state_t = cat25256::persistent<state, cat25256::after<calibration_t, CAT25256_PAGE_SIZE>::value>;
+    constexpr cat25256::layout<calibration_t, state_t> layout{};
+
+    static_assert(state_t::address == CAT25256_PAGE_SIZE, "after rounds up to the alignment");
+
+    cat25256_sim_t sim;
+}
+
+int main() {
+    (void) layout;
+    cat25256_sim_init(&sim, 0, 0);
+    cat25256_handle_t handle = {};
+    cat25256_sim_attach(&sim, &handle);
+
+    state_t state_var(&handle, 0);
+    CHECK(state_var.load() == MEMORY_STATUS_OK);
+    CHECK(!state_var.dirty());
+
+    state_var.set(&state::flags, 0x0010);
+    state_var.set(&state::mode, 3);
+    state_var.set(&state::boot_count, 0);
+    state_var.set(&state::checksum, 0xAu);
+    CHECK(state_var.dirty());
+
+    cat25256_sim_reset_stats(&sim);
+    CHECK(state_var.commit() == MEMORY_STATUS_OK);
+    CHECK(!state_var.dirty());
+    // flags and mode share the first page of the variable, checksum sits on the next one
+    CHECK(sim.stats.page_programs == 2);
+
+    state_t reloaded(&handle, 0);
+    CHECK(reloaded.load() == MEMORY_STATUS_OK);
+    CHECK(reloaded.get().flags == 0x0010);
+    CHECK(reloaded.get().mode == 3);
+    CHECK(reloaded.get().boot_count == 0);
+    CHECK(reloaded.get().checksum == 0xA);
+
+    // Setting a field to its current value marks nothing
+    reloaded.set(&state::mode, 3);
+    CHECK(!reloaded.dirty());
+
+    // The value is an int and converts to the field type instead of taking part in deduction, bit 0 is clear
+    // on the device so the new value has to reach it
+    reloaded.set(&state::flags, reloaded.get().flags | 1);
+    CHECK(reloaded.dirty());
+    cat25256_sim_reset_stats(&sim);
+    CHECK(reloaded.commit() == MEMORY_STATUS_OK);
+    CHECK(sim.stats.page_programs == 1);
+
+    state_t again(&handle, 0);
+    CHECK(again.load() == MEMORY_STATUS_OK);
+    CHECK(again.get().flags == 0x0011);
+    CHECK(again.get().mode == 3);
+    return TEST_RESULT();
+}
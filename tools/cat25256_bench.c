@@ -0,0 +1,522 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Per-operation benchmark of the driver against the simulated chip, times are on the simulator's virtual clock.
+ *
+ * Usage: cat25256_bench [--clock <hz>] [--twc <us>] [--repeat <n>]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cat25256.h"
+#include "cat25256_sim.h"
+#include "cat25256_typed.h"
+
+#define BENCH_CACHED (CAT25256_PROFILE == CAT25256_PROFILE_CACHED || CAT25256_PROFILE == CAT25256_PROFILE_FULL)
+#define BENCH_HOLD CAT25256_FEATURE_HOLD
+#define BENCH_BLOB (CAT25256_PROFILE == CAT25256_PROFILE_FULL)
+
+#if BENCH_CACHED
+#include "cat25256_batch.h"
+#include "cat25256_partition.h"
+#endif
+#if BENCH_BLOB
+#include "cat25256_blob.h"
+#endif
+
+#define BENCH_MAX_LENGTH 4096
+
+static const char *const profile_names[] = {"", "minimal", "cached", "async", "full"};
+
+typedef struct {
+    const char *name;
+    uint8_t write;
+    uint32_t address;
+    uint32_t length;
+} bench_op_t;
+
+static const bench_op_t ops[] = {
+        {"read 1 B", 0, 0x0100, 1},
+        {"read 32 B", 0, 0x0100, 32},
+        {"read 4 KiB", 0, 0x1000, 4096},
+        {"write 1 B", 1, 0x0100, 1},
+        {"write page", 1, 0x0200, CAT25256_PAGE_SIZE},
+        {"write 256 B unaligned", 1, 0x0310, 256},
+        {"write 4 KiB", 1, 0x2000, 4096},
+};
+
+#define BENCH_FIELDS 30
+
+static uint8_t buffer[BENCH_MAX_LENGTH];
+
+static uint64_t field_values[BENCH_FIELDS];
+
+static const uint8_t type_sizes[] = {1, 2, 4, 8, 4};
+
+/**
+ * A configuration record: 30 naturally aligned fields of mixed types, with a reserved block after every tenth
+ */
+static void bench_fields(cat25256_typed_field_t *fields) {
+    static const cat25256_type_t types[] = {CAT25256_TYPE_U16, CAT25256_TYPE_U32, CAT25256_TYPE_F32,
+                                            CAT25256_TYPE_U8, CAT25256_TYPE_U64};
+    uint32_t address = 0x0800;
+    for (int i = 0; i < BENCH_FIELDS; i++) {
+        uint8_t size = type_sizes[types[i % 5]];
+        address = (address + size - 1) / size * size;
+        fields[i].address = address;
+        fields[i].type = types[i % 5];
+        fields[i].value = &field_values[i];
+        address += size;
+        if (i % 10 == 9) {
+            address += 16;
+        }
+    }
+}
+
+static void bench_print(const char *name, cat25256_sim_t *sim, uint64_t start, uint32_t repeat) {
+    uint64_t elapsed = cat25256_sim_now_ns(sim) - start;
+    uint64_t energy_pj = cat25256_sim_energy_pj(sim);
+    printf("%-24s %12.1f %10.3f %8.1f %10.1f %8.1f\n", name, elapsed / 1000.0 / repeat, energy_pj / 1e6 / repeat,
+           (double) sim->stats.transactions / repeat, (double) sim->stats.bus_bytes / repeat,
+           (double) sim->stats.page_programs / repeat);
+}
+
+static int bench_gather(cat25256_sim_t *sim, cat25256_handle_t *handle, uint32_t repeat) {
+    cat25256_typed_field_t fields[BENCH_FIELDS];
+    bench_fields(fields);
+
+    cat25256_sim_reset_stats(sim);
+    uint64_t start = cat25256_sim_now_ns(sim);
+    for (uint32_t run = 0; run < repeat; run++) {
+        for (int i = 0; i < BENCH_FIELDS; i++) {
+            if (cat25256_read(handle, fields[i].address, (uint8_t *) fields[i].value, type_sizes[fields[i].type], 0) !=
+                MEMORY_STATUS_OK) {
+                return 1;
+            }
+        }
+    }
+    bench_print("30 fields one by one", sim, start, repeat);
+
+    cat25256_sim_reset_stats(sim);
+    start = cat25256_sim_now_ns(sim);
+    for (uint32_t run = 0; run < repeat; run++) {
+        if (cat25256_gather_read(handle, fields, BENCH_FIELDS, 0, NULL, 0) != MEMORY_STATUS_OK) {
+            return 1;
+        }
+    }
+    bench_print("30 fields gathered", sim, start, repeat);
+    return 0;
+}
+
+#if CAT25256_FEATURE_ADAPTIVE_WAIT
+
+/**
+ * Page programs with plain busy polling and with the adaptive write-cycle wait, same data and page
+ */
+static int bench_wait(cat25256_sim_t *sim, cat25256_handle_t *handle, uint32_t repeat) {
+    uint32_t (*get_time_us)(void *) = handle->get_time_us;
+    void (*delay_us)(void *, uint32_t) = handle->delay_us;
+
+    for (int adaptive = 0; adaptive < 2; adaptive++) {
+        handle->get_time_us = adaptive ? get_time_us : NULL;
+        handle->delay_us = adaptive ? delay_us : NULL;
+        cat25256_sim_reset_stats(sim);
+        uint64_t start = cat25256_sim_now_ns(sim);
+        for (uint32_t run = 0; run < repeat; run++) {
+            memset(buffer, (int) run, CAT25256_PAGE_SIZE);
+            if (cat25256_write_page(handle, 0x0600, buffer, CAT25256_PAGE_SIZE, 0) != MEMORY_STATUS_OK) {
+                handle->get_time_us = get_time_us;
+                handle->delay_us = delay_us;
+                return 1;
+            }
+        }
+        bench_print(adaptive ? "  adaptive wait" : "write page, busy poll", sim, start, repeat);
+        printf("  %.1f status polls per program\n", (double) sim->stats.status_polls / repeat);
+    }
+    return 0;
+}
+
+#endif
+
+#if BENCH_CACHED
+
+#define BENCH_SCAN_LENGTH 2048
+#define BENCH_READAHEAD_SIZE 256
+
+/**
+ * Boot loader style table walks with and without readahead: 8 byte records back to back, 12 byte entries
+ * read as 4 + 8 bytes, and 8 byte reads at random places for the cost of readahead on non-sequential access
+ */
+static int bench_scan(cat25256_sim_t *sim, cat25256_handle_t *handle, uint32_t repeat) {
+    static uint8_t ra_buffer[BENCH_READAHEAD_SIZE];
+    static const char *const names[] = {"scan 8 B records", "scan 4+8 B entries", "random 8 B reads"};
+
+    for (int workload = 0; workload < 3; workload++) {
+        cat25256_readahead_t ra = {.buffer = ra_buffer, .size = sizeof ra_buffer};
+        for (int readahead = 0; readahead < 2; readahead++) {
+            handle->readahead = readahead ? &ra : NULL;
+            cat25256_sim_reset_stats(sim);
+            uint64_t start = cat25256_sim_now_ns(sim);
+            uint32_t seed = 1;
+            for (uint32_t run = 0; run < repeat; run++) {
+                for (uint32_t offset = 0; offset < BENCH_SCAN_LENGTH; offset += workload == 1 ? 12 : 8) {
+                    uint32_t address = 0x4000 + offset;
+                    memory_status_t rc;
+                    if (workload == 1) {
+                        rc = cat25256_read(handle, address, buffer, 4, 0);
+                        if (rc == MEMORY_STATUS_OK) {
+                            rc = cat25256_read(handle, address + 4, buffer, 8, 0);
+                        }
+                    } else {
+                        if (workload == 2) {
+                            seed = seed * 1103515245u + 12345u;
+                            address = 0x4000 + (seed >> 16) % (BENCH_SCAN_LENGTH - 8);
+                        }
+                        rc = cat25256_read(handle, address, buffer, 8, 0);
+                    }
+                    if (rc != MEMORY_STATUS_OK) {
+                        handle->readahead = NULL;
+                        return 1;
+                    }
+                }
+            }
+            bench_print(readahead ? "  with readahead" : names[workload], sim, start, repeat);
+        }
+        printf("  readahead: %lu hits, %lu misses, final window %u\n", (unsigned long) ra.hits,
+               (unsigned long) ra.misses, ra.window);
+    }
+    handle->readahead = NULL;
+    return 0;
+}
+
+#define BENCH_SMALL_READS 32
+
+/**
+ * Independent 2 to 8 byte reads scattered over a 256 byte table, as issued by unrelated modules
+ */
+static int bench_batch(cat25256_sim_t *sim, cat25256_handle_t *handle, uint32_t repeat) {
+    static cat25256_read_request_t requests[BENCH_SMALL_READS];
+    static cat25256_read_request_t *queue[BENCH_SMALL_READS];
+    uint32_t seed = 1;
+    for (int i = 0; i < BENCH_SMALL_READS; i++) {
+        seed = seed * 1103515245u + 12345u;
+        requests[i].address = 0x0C00 + (seed >> 16) % 248;
+        requests[i].length = 2 + (seed >> 8) % 7;
+        requests[i].data = &buffer[i * 8];
+    }
+
+    cat25256_sim_reset_stats(sim);
+    uint64_t start = cat25256_sim_now_ns(sim);
+    for (uint32_t run = 0; run < repeat; run++) {
+        for (int i = 0; i < BENCH_SMALL_READS; i++) {
+            if (cat25256_read(handle, requests[i].address, requests[i].data, requests[i].length, 0) !=
+                MEMORY_STATUS_OK) {
+                return 1;
+            }
+        }
+    }
+    bench_print("32 small reads", sim, start, repeat);
+
+    cat25256_batch_t batch = {.handle = handle, .cs = 0, .queue = queue, .capacity = BENCH_SMALL_READS};
+    cat25256_sim_reset_stats(sim);
+    start = cat25256_sim_now_ns(sim);
+    for (uint32_t run = 0; run < repeat; run++) {
+        for (int i = 0; i < BENCH_SMALL_READS; i++) {
+            cat25256_batch_submit(&batch, &requests[i]);
+        }
+        if (cat25256_batch_flush(&batch) != MEMORY_STATUS_OK) {
+            return 1;
+        }
+    }
+    bench_print("32 small reads batched", sim, start, repeat);
+    printf("  batch: %.1f bursts, %.1f bus bytes (unbatched %.1f), %.1f us bus time (unbatched %.1f)\n",
+           (double) batch.stats.bursts / repeat, (double) batch.stats.bus_bytes / repeat,
+           (double) batch.stats.unbatched_bus_bytes / repeat, (double) batch.stats.bus_time_us / repeat,
+           (double) batch.stats.unbatched_bus_time_us / repeat);
+    printf("  batch: mean latency %.1f us (unbatched %.1f), max %lu us (unbatched %lu)\n",
+           (double) batch.stats.latency_total_us / batch.stats.requests,
+           (double) batch.stats.unbatched_latency_total_us / batch.stats.requests,
+           (unsigned long) batch.stats.latency_max_us, (unsigned long) batch.stats.unbatched_latency_max_us);
+    return 0;
+}
+
+#define BENCH_UPDATES 64
+#define BENCH_RECORD_SIZE 4
+#define BENCH_FLUSH_EVERY 16
+
+/**
+ * Settings style updates: 4 byte records in 16 slots over 4 pages, every other update stores an unchanged value.
+ * The same sequence goes through a write-through, a compare-before-write and a write-back partition, the
+ * write-back one flushed every 16 updates.
+ */
+static int bench_strategies(cat25256_sim_t *sim, cat25256_handle_t *handle, uint32_t repeat) {
+    static const cat25256_partition_entry_t layout[] = {
+            {.id = 1, .policy = CAT25256_POLICY_WRITE_THROUGH, .start = 0x7040, .size = 0x0100},
+            {.id = 2, .policy = CAT25256_POLICY_COMPARE, .start = 0x7140, .size = 0x0100},
+            {.id = 3, .policy = CAT25256_POLICY_WRITE_BACK, .start = 0x7240, .size = 0x0100},
+    };
+    static const char *const names[] = {"64 updates write-through", "  compare-before-write",
+                                        "  write-back, batched"};
+    static cat25256_cache_slot_t slots[4];
+    cat25256_partition_table_t table = {.handle = handle, .cs = 0, .table_address = 0x7000};
+    if (cat25256_partition_format(&table, layout, 3) != MEMORY_STATUS_OK ||
+        cat25256_partition_attach_cache(&table, 3, slots, 4) != MEMORY_STATUS_OK) {
+        return 1;
+    }
+
+    for (uint8_t id = 1; id <= 3; id++) {
+        cat25256_sim_reset_stats(sim);
+        uint64_t start = cat25256_sim_now_ns(sim);
+        for (uint32_t run = 0; run < repeat; run++) {
+            for (uint32_t update = 0; update < BENCH_UPDATES; update++) {
+                uint32_t slot = update * 7 % 16;
+                uint8_t record[BENCH_RECORD_SIZE];
+                memset(record, update % 2 ? 0x55 : (int) (run * BENCH_UPDATES + update), sizeof record);
+                if (cat25256_partition_write(&table, id, slot * 16, record, sizeof record) != MEMORY_STATUS_OK) {
+                    return 1;
+                }
+                if ((update + 1) % BENCH_FLUSH_EVERY == 0 && cat25256_partition_flush(&table) != MEMORY_STATUS_OK) {
+                    return 1;
+                }
+            }
+        }
+        bench_print(names[id - 1], sim, start, repeat);
+        printf("  %.3f uJ per stored byte\n",
+               cat25256_sim_energy_pj(sim) / 1e6 / ((double) repeat * BENCH_UPDATES * BENCH_RECORD_SIZE));
+    }
+    return 0;
+}
+
+#endif
+
+#if BENCH_HOLD
+
+#define BENCH_ADC_BYTES 4
+#define BENCH_HOLD_CHUNK 8
+
+static uint64_t last_service_ns;
+static uint64_t longest_gap_ns;
+
+/**
+ * Stands in for the ADC sharing the bus: clocks a short transfer and records the longest time it had to wait
+ */
+static void bench_adc_transfer(void *handle) {
+    cat25256_sim_t *sim = handle;
+    uint64_t now = cat25256_sim_now_ns(sim);
+    if (now - last_service_ns > longest_gap_ns) {
+        longest_gap_ns = now - last_service_ns;
+    }
+    sim->now_ns += CAT25256_SIM_CS_OVERHEAD_NS + (uint64_t) BENCH_ADC_BYTES * 8 * 1000000000u / sim->spi_clock_hz;
+    last_service_ns = sim->now_ns;
+}
+
+static int bench_hold(cat25256_sim_t *sim, cat25256_handle_t *handle, uint32_t repeat) {
+    for (int chunked = 0; chunked < 2; chunked++) {
+        handle->urgent_transfer = bench_adc_transfer;
+        handle->hold_chunk_size = chunked ? BENCH_HOLD_CHUNK : 0;
+        longest_gap_ns = 0;
+        cat25256_sim_reset_stats(sim);
+        uint64_t start = cat25256_sim_now_ns(sim);
+        for (uint32_t run = 0; run < repeat; run++) {
+            last_service_ns = cat25256_sim_now_ns(sim);
+            if (cat25256_read(handle, 0x1000, buffer, 4096, 0) != MEMORY_STATUS_OK) {
+                return 1;
+            }
+            bench_adc_transfer(sim);
+        }
+        bench_print(chunked ? "  paused on HOLD" : "read 4 KiB, shared bus", sim, start, repeat);
+        printf("  longest bus hold %.1f us\n", longest_gap_ns / 1000.0);
+    }
+    handle->urgent_transfer = NULL;
+    handle->hold_chunk_size = 0;
+    return 0;
+}
+
+#endif
+
+#if BENCH_BLOB
+
+#define BENCH_BLOB_LENGTH 2048
+#define BENCH_BLOB_ADDRESS 0x5000
+#define BENCH_BLOB_CAPACITY 0x0C00
+
+/**
+ * Page programs of storing data raw and as a compressed blob: a table of 16 byte steps, a fault snapshot of repeated
+ * records and noise, which the blob stores raw
+ */
+static void bench_blob_data(int kind, uint8_t *data) {
+    uint32_t state = 0x2545F491u;
+    for (uint32_t i = 0; i < BENCH_BLOB_LENGTH; i++) {
+        state = state * 1103515245u + 12345u;
+        switch (kind) {
+            case 0:
+                data[i] = (uint8_t) (i / 16);
+                break;
+            case 1:
+                data[i] = i % 32 < 4 ? (uint8_t) (i / 32) : (i % 32 < 8 ? 0xE5 : 0);
+                break;
+            default:
+                data[i] = (uint8_t) (state >> 24);
+                break;
+        }
+    }
+}
+
+static int bench_blob(cat25256_sim_t *sim, cat25256_handle_t *handle, uint32_t repeat) {
+    static const char *const names[] = {"2 KiB step table raw", "2 KiB snapshot raw", "2 KiB noise raw"};
+    uint8_t *data = buffer;
+    uint8_t *back = &buffer[BENCH_BLOB_LENGTH];
+
+    for (int kind = 0; kind < 3; kind++) {
+        bench_blob_data(kind, data);
+
+        cat25256_sim_reset_stats(sim);
+        uint64_t start = cat25256_sim_now_ns(sim);
+        for (uint32_t run = 0; run < repeat; run++) {
+            if (cat25256_write(handle, BENCH_BLOB_ADDRESS, data, BENCH_BLOB_LENGTH, 0) != MEMORY_STATUS_OK) {
+                return 1;
+            }
+        }
+        bench_print(names[kind], sim, start, repeat);
+        uint32_t raw_programs = sim->stats.page_programs;
+
+        uint32_t stored = 0;
+        cat25256_sim_reset_stats(sim);
+        start = cat25256_sim_now_ns(sim);
+        for (uint32_t run = 0; run < repeat; run++) {
+            if (cat25256_blob_write(handle, BENCH_BLOB_ADDRESS, BENCH_BLOB_CAPACITY, data, BENCH_BLOB_LENGTH, &stored,
+                                    0) != MEMORY_STATUS_OK) {
+                return 1;
+            }
+        }
+        bench_print("  as blob", sim, start, repeat);
+        uint32_t blob_programs = sim->stats.page_programs;
+
+        uint32_t length = 0;
+        cat25256_sim_reset_stats(sim);
+        start = cat25256_sim_now_ns(sim);
+        for (uint32_t run = 0; run < repeat; run++) {
+            if (cat25256_blob_read(handle, BENCH_BLOB_ADDRESS, back, BENCH_BLOB_LENGTH, &length, 0) !=
+                MEMORY_STATUS_OK) {
+                return 1;
+            }
+        }
+        bench_print("  blob read back", sim, start, repeat);
+        if (length != BENCH_BLOB_LENGTH || memcmp(data, back, BENCH_BLOB_LENGTH) != 0) {
+            return 1;
+        }
+        printf("  %lu of %u bytes stored, ratio %.2f, %.1f%% of the page programs\n", (unsigned long) stored,
+               BENCH_BLOB_LENGTH, (double) BENCH_BLOB_LENGTH / stored, 100.0 * blob_programs / raw_programs);
+    }
+    return 0;
+}
+
+#endif
+
+int main(int argc, char **argv) {
+    uint32_t clock_hz = 0;
+    uint32_t write_cycle_us = 3000;
+    uint32_t repeat = 8;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--clock") == 0) {
+            clock_hz = (uint32_t) strtoul(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "--twc") == 0) {
+            write_cycle_us = (uint32_t) strtoul(argv[i + 1], NULL, 0);
+        } else if (strcmp(argv[i], "--repeat") == 0) {
+            repeat = (uint32_t) strtoul(argv[i + 1], NULL, 0);
+        } else {
+            fprintf(stderr, "usage: %s [--clock <hz>] [--twc <us>] [--repeat <n>]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (repeat == 0) {
+        repeat = 1;
+    }
+
+    static cat25256_sim_t sim;
+    cat25256_sim_init(&sim, clock_hz, write_cycle_us);
+    cat25256_handle_t handle = {0};
+    cat25256_sim_attach(&sim, &handle);
+
+    printf("profile %s, SPI %lu Hz, tWC %lu us, %lu runs per operation\n", profile_names[CAT25256_PROFILE],
+           (unsigned long) sim.spi_clock_hz, (unsigned long) sim.write_cycle_us, (unsigned long) repeat);
+    printf("supply %lu mV, standby %lu nA, active %lu uA + %lu uA/MHz, write cycle %lu uA\n",
+           (unsigned long) sim.energy.supply_mv, (unsigned long) sim.energy.standby_na,
+           (unsigned long) sim.energy.active_ua, (unsigned long) sim.energy.active_ua_per_mhz,
+           (unsigned long) sim.energy.write_cycle_ua);
+    printf("%-24s %12s %10s %8s %10s %8s\n", "operation", "time_us", "energy_uj", "txns", "bus_bytes", "programs");
+
+    for (size_t op = 0; op < sizeof ops / sizeof ops[0]; op++) {
+        cat25256_sim_reset_stats(&sim);
+        uint64_t start = cat25256_sim_now_ns(&sim);
+
+        for (uint32_t run = 0; run < repeat; run++) {
+            memset(buffer, (int) (run + op), ops[op].length);
+            memory_status_t rc;
+            if (ops[op].write) {
+                rc = cat25256_write(&handle, ops[op].address, buffer, ops[op].length, 0);
+            } else {
+                rc = cat25256_read(&handle, ops[op].address, buffer, ops[op].length, 0);
+            }
+            if (rc != MEMORY_STATUS_OK) {
+                fprintf(stderr, "%s failed with %d\n", ops[op].name, rc);
+                return 1;
+            }
+        }
+
+        bench_print(ops[op].name, &sim, start, repeat);
+    }
+
+#if CAT25256_FEATURE_ADAPTIVE_WAIT
+    if (bench_wait(&sim, &handle, repeat) != 0) {
+        fprintf(stderr, "page write failed\n");
+        return 1;
+    }
+#endif
+    if (bench_gather(&sim, &handle, repeat) != 0) {
+        fprintf(stderr, "gather read failed\n");
+        return 1;
+    }
+#if BENCH_HOLD
+    if (bench_hold(&sim, &handle, repeat) != 0) {
+        fprintf(stderr, "read with HOLD failed\n");
+        return 1;
+    }
+#endif
+#if BENCH_CACHED
+    if (bench_scan(&sim, &handle, repeat) != 0) {
+        fprintf(stderr, "scan failed\n");
+        return 1;
+    }
+    if (bench_batch(&sim, &handle, repeat) != 0) {
+        fprintf(stderr, "batched read failed\n");
+        return 1;
+    }
+    if (bench_strategies(&sim, &handle, repeat) != 0) {
+        fprintf(stderr, "partition write failed\n");
+        return 1;
+    }
+#endif
+#if BENCH_BLOB
+    if (bench_blob(&sim, &handle, repeat) != 0) {
+        fprintf(stderr, "blob failed\n");
+        return 1;
+    }
+#endif
+    return 0;
+}
@@ -0,0 +1,157 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Throughput of the multi-bus dispatcher over 1 to BENCH_BUSES simulated buses. Every bus has its own
+ * simulator and virtual clock, throughput is the data moved over the virtual time of the slowest bus.
+ * Workers sleep for a fraction of the virtual time each transaction took, so that work stealing follows
+ * bus occupancy rather than host CPU speed.
+ *
+ * Usage: cat25256_dispatch_bench [--clock <hz>]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "cat25256_dispatch.h"
+#include "cat25256_sim.h"
+
+#define BENCH_BUSES 3
+#define BENCH_JOBS 24
+#define BENCH_JOB_LENGTH 4096
+#define BENCH_STRIPED_LENGTH 24576
+#define BENCH_STRIPE_SIZE 512
+#define BENCH_PACE_DIVIDER 20
+
+static cat25256_sim_t sims[BENCH_BUSES];
+static cat25256_handle_t handles[BENCH_BUSES];
+static cat25256_bus_t buses[BENCH_BUSES];
+static uint8_t data[BENCH_JOBS][BENCH_JOB_LENGTH];
+static uint8_t striped[BENCH_STRIPED_LENGTH];
+static memory_status_t (*sim_cs_disable)(void *handle, size_t cs);
+static uint64_t paced_ns[BENCH_BUSES];
+
+static memory_status_t bench_paced_cs_disable(void *handle, size_t cs) {
+    cat25256_sim_t *sim = handle;
+    memory_status_t rc = sim_cs_disable(handle, cs);
+
+    size_t bus = (size_t) (sim - sims);
+    uint64_t elapsed = (cat25256_sim_now_ns(sim) - paced_ns[bus]) / BENCH_PACE_DIVIDER;
+    paced_ns[bus] = cat25256_sim_now_ns(sim);
+    struct timespec pause = {.tv_sec = (time_t) (elapsed / 1000000000u), .tv_nsec = (long) (elapsed % 1000000000u)};
+    nanosleep(&pause, NULL);
+    return rc;
+}
+
+static uint64_t bench_makespan(const uint64_t *start, size_t bus_count) {
+    uint64_t longest = 0;
+    for (size_t i = 0; i < bus_count; i++) {
+        uint64_t elapsed = cat25256_sim_now_ns(&sims[i]) - start[i];
+        longest = elapsed > longest ? elapsed : longest;
+    }
+    return longest;
+}
+
+static void bench_report(const char *name, size_t bus_count, uint64_t makespan_ns, uint32_t bytes, uint32_t stolen) {
+    printf("%-22s %5lu %12.1f %12.1f %8lu\n", name, (unsigned long) bus_count, makespan_ns / 1000.0,
+           bytes / (makespan_ns / 1e9) / 1024.0, (unsigned long) stolen);
+}
+
+static int bench_run(size_t bus_count) {
+    uint64_t start[BENCH_BUSES];
+    cat25256_dispatcher_t dispatcher = {.buses = buses, .bus_count = bus_count};
+    for (size_t i = 0; i < bus_count; i++) {
+        buses[i].handle = &handles[i];
+    }
+    if (cat25256_dispatch_start(&dispatcher) != MEMORY_STATUS_OK) {
+        return 1;
+    }
+
+    // Independent reads spread over the buses
+    static cat25256_job_t jobs[BENCH_JOBS];
+    for (size_t i = 0; i < bus_count; i++) {
+        start[i] = cat25256_sim_now_ns(&sims[i]);
+    }
+    for (size_t i = 0; i < BENCH_JOBS; i++) {
+        jobs[i] = (cat25256_job_t) {.type = CAT25256_JOB_READ, .location = {.bus = i % bus_count, .cs = 0},
+                .address = (uint32_t) (i * BENCH_JOB_LENGTH) % CAT25256_CAPACITY, .data = data[i],
+                .length = BENCH_JOB_LENGTH};
+        cat25256_dispatch_submit(&dispatcher, &jobs[i]);
+    }
+    for (size_t i = 0; i < BENCH_JOBS; i++) {
+        if (cat25256_dispatch_wait(&dispatcher, &jobs[i]) != MEMORY_STATUS_OK) {
+            cat25256_dispatch_stop(&dispatcher);
+            return 1;
+        }
+    }
+    bench_report("independent 4 KiB", bus_count, bench_makespan(start, bus_count), BENCH_JOBS * BENCH_JOB_LENGTH, 0);
+
+    // One large read from a part mirrored on every bus, the other workers steal stripes
+    cat25256_location_t mirrors[BENCH_BUSES - 1];
+    for (size_t i = 1; i < bus_count; i++) {
+        mirrors[i - 1] = (cat25256_location_t) {.bus = i, .cs = 0};
+    }
+    uint32_t stolen = 0;
+    for (size_t i = 0; i < bus_count; i++) {
+        start[i] = cat25256_sim_now_ns(&sims[i]);
+        stolen -= buses[i].stolen;
+    }
+    cat25256_job_t job = {.type = CAT25256_JOB_READ, .location = {.bus = 0, .cs = 0}, .address = 0,
+            .data = striped, .length = BENCH_STRIPED_LENGTH, .mirrors = mirrors, .mirror_count = bus_count - 1,
+            .stripe_size = BENCH_STRIPE_SIZE};
+    cat25256_dispatch_submit(&dispatcher, &job);
+    memory_status_t rc = cat25256_dispatch_wait(&dispatcher, &job);
+    for (size_t i = 0; i < bus_count; i++) {
+        stolen += buses[i].stolen;
+    }
+    cat25256_dispatch_stop(&dispatcher);
+    if (rc != MEMORY_STATUS_OK || memcmp(striped, sims[0].memory, BENCH_STRIPED_LENGTH) != 0) {
+        return 1;
+    }
+    bench_report("striped 24 KiB", bus_count, bench_makespan(start, bus_count), BENCH_STRIPED_LENGTH, stolen);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    uint32_t clock_hz = 0;
+    if (argc == 3 && strcmp(argv[1], "--clock") == 0) {
+        clock_hz = (uint32_t) strtoul(argv[2], NULL, 0);
+    } else if (argc != 1) {
+        fprintf(stderr, "usage: %s [--clock <hz>]\n", argv[0]);
+        return 2;
+    }
+
+    for (size_t i = 0; i < BENCH_BUSES; i++) {
+        cat25256_sim_init(&sims[i], clock_hz, 0);
+        cat25256_sim_attach(&sims[i], &handles[i]);
+        sim_cs_disable = handles[i].cs_disable;
+        handles[i].cs_disable = bench_paced_cs_disable;
+        // Mirrored parts hold the same data
+        for (uint32_t a = 0; a < CAT25256_CAPACITY; a++) {
+            sims[i].memory[a] = (uint8_t) (a * 31 + (a >> 8));
+        }
+    }
+
+    printf("%-22s %5s %12s %12s %8s\n", "workload", "buses", "time_us", "KiB/s", "stolen");
+    for (size_t bus_count = 1; bus_count <= BENCH_BUSES; bus_count++) {
+        if (bench_run(bus_count) != 0) {
+            fprintf(stderr, "dispatch over %lu buses failed\n", (unsigned long) bus_count);
+            return 1;
+        }
+    }
+    return 0;
+}
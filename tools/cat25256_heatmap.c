@@ -0,0 +1,121 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Host tool rendering the wear heatmap stored in a CAT25256 memory dump.
+ *
+ * Usage: cat25256_heatmap [--csv] <image> <area> <slots> <first_page> <page_count>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cat25256_wear.h"
+
+#define PAGES_PER_ROW 32
+
+static const char levels[] = " .:-=+*#%@";
+
+static void print_usage(const char *name) {
+    fprintf(stderr, "Usage: %s [--csv] <image> <area> <slots> <first_page> <page_count>\n", name);
+}
+
+int main(int argc, char **argv) {
+    int csv = 0;
+    int arg = 1;
+    if (argc > 1 && strcmp(argv[1], "--csv") == 0) {
+        csv = 1;
+        arg++;
+    }
+    if (argc - arg != 5) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char *path = argv[arg];
+    uint32_t area = strtoul(argv[arg + 1], NULL, 0);
+    uint32_t slots = strtoul(argv[arg + 2], NULL, 0);
+    uint32_t first_page = strtoul(argv[arg + 3], NULL, 0);
+    uint32_t page_count = strtoul(argv[arg + 4], NULL, 0);
+    if (page_count == 0 || page_count > CAT25256_CAPACITY / CAT25256_PAGE_SIZE || slots == 0) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    static uint8_t image[CAT25256_CAPACITY];
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+    size_t length = fread(image, 1, sizeof image, file);
+    fclose(file);
+
+    static uint32_t counters[CAT25256_CAPACITY / CAT25256_PAGE_SIZE];
+    static uint32_t candidate[CAT25256_CAPACITY / CAT25256_PAGE_SIZE];
+    uint32_t sequence = 0;
+    int found = 0;
+
+    for (uint32_t slot = 0; slot < slots; ++slot) {
+        uint32_t address = area + slot * CAT25256_WEAR_SLOT_SIZE(page_count);
+        uint16_t stored_first_page;
+        uint32_t stored_sequence;
+
+        if (address + CAT25256_WEAR_SLOT_SIZE(page_count) > length) {
+            break;
+        }
+        if (cat25256_wear_decode(&image[address], page_count, &stored_first_page, candidate, &stored_sequence) !=
+            MEMORY_STATUS_OK || stored_first_page != first_page) {
+            continue;
+        }
+        if (!found || stored_sequence > sequence) {
+            memcpy(counters, candidate, page_count * sizeof counters[0]);
+            sequence = stored_sequence;
+            found = 1;
+        }
+    }
+
+    if (!found) {
+        fprintf(stderr, "%s: no valid wear snapshot found\n", path);
+        return EXIT_FAILURE;
+    }
+
+    if (csv) {
+        printf("page,address,programs,permille\n");
+        for (uint32_t i = 0; i < page_count; ++i) {
+            printf("%u,0x%04x,%u,%u\n", first_page + i, (first_page + i) * CAT25256_PAGE_SIZE, counters[i],
+                   (unsigned) ((uint64_t) counters[i] * 1000 / CAT25256_ENDURANCE_CYCLES));
+        }
+        return EXIT_SUCCESS;
+    }
+
+    uint32_t max = 0;
+    for (uint32_t i = 0; i < page_count; ++i) {
+        max = counters[i] > max ? counters[i] : max;
+    }
+
+    printf("snapshot %u, most programmed page: %u programs (%u permille of endurance)\n", sequence, max,
+           (unsigned) ((uint64_t) max * 1000 / CAT25256_ENDURANCE_CYCLES));
+    for (uint32_t i = 0; i < page_count; ++i) {
+        if (i % PAGES_PER_ROW == 0) {
+            printf("%s0x%04x |", i == 0 ? "" : "|\n", (first_page + i) * CAT25256_PAGE_SIZE);
+        }
+        size_t level = max == 0 ? 0 : (size_t) ((uint64_t) counters[i] * (sizeof levels - 2) / max);
+        putchar(levels[level]);
+    }
+    printf("|\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,271 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Power-cut sweep over the crash recovery of the delta store or the log partition on the simulated chip.
+ *
+ * Usage: cat25256_powercut [--csv] [--time-step <us> | --programs] [--seed <n>] delta|log
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cat25256_delta.h"
+#include "cat25256_partition.h"
+#include "cat25256_powercut.h"
+
+#define DELTA_SIZE 48
+#define DELTA_LOG_SIZE 192
+#define DELTA_COMMITS 8
+
+#define LOG_ID 1
+#define LOG_START 0x0040
+#define LOG_SIZE 0x0400
+#define LOG_RECORDS 12
+#define LOG_HEADER_SIZE 4
+
+static cat25256_powercut_t sweep;
+
+static const char *const torn_names[] = {"old", "new", "mixed"};
+static const char *const status_names[] = {"ok", "nok", "invalid_handle", "protected", "out_of_range"};
+
+/*
+ * Delta store: a sequence of commits, after a restart the state must be the last committed one or the one that
+ * was being committed when power failed
+ */
+
+typedef struct {
+    uint8_t snapshots[DELTA_COMMITS + 1][DELTA_SIZE];
+    uint8_t workspace[CAT25256_DELTA_REGION_SIZE(DELTA_SIZE, DELTA_LOG_SIZE)];
+    uint32_t committed;
+} delta_app_t;
+
+static delta_app_t delta_app;
+
+static void delta_store(cat25256_delta_t *store, cat25256_handle_t *handle) {
+    memset(store, 0, sizeof *store);
+    store->handle = handle;
+    store->address = 0x0000;
+    store->size = DELTA_SIZE;
+    store->log_size = DELTA_LOG_SIZE;
+    store->compact_after = 4;
+    store->workspace = delta_app.workspace;
+}
+
+static memory_status_t delta_prepare(void *context, cat25256_handle_t *handle) {
+    delta_app_t *app = context;
+    for (uint32_t i = 0; i <= DELTA_COMMITS; i++) {
+        for (uint32_t b = 0; b < DELTA_SIZE; b++) {
+            // Every commit changes a few bytes of the previous state
+            app->snapshots[i][b] = i == 0 ? (uint8_t) b : app->snapshots[i - 1][b];
+        }
+        if (i > 0) {
+            app->snapshots[i][(i * 7) % DELTA_SIZE] ^= 0x5A;
+            app->snapshots[i][(i * 13) % DELTA_SIZE] += (uint8_t) i;
+        }
+    }
+
+    cat25256_delta_t store;
+    delta_store(&store, handle);
+    cat25256_delta_load(&store);
+    return cat25256_delta_commit(&store, app->snapshots[0]);
+}
+
+static memory_status_t delta_run(void *context, cat25256_handle_t *handle) {
+    delta_app_t *app = context;
+    app->committed = 0;
+
+    cat25256_delta_t store;
+    delta_store(&store, handle);
+    memory_status_t rc = cat25256_delta_load(&store);
+    for (uint32_t i = 1; rc == MEMORY_STATUS_OK && i <= DELTA_COMMITS; i++) {
+        rc = cat25256_delta_commit(&store, app->snapshots[i]);
+        if (rc == MEMORY_STATUS_OK) {
+            app->committed = i;
+        }
+    }
+    return rc;
+}
+
+static memory_status_t delta_recover(void *context, cat25256_handle_t *handle) {
+    delta_app_t *app = context;
+    cat25256_delta_t store;
+    delta_store(&store, handle);
+    if (cat25256_delta_load(&store) != MEMORY_STATUS_OK) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    const uint8_t *state = cat25256_delta_state(&store);
+    if (memcmp(state, app->snapshots[app->committed], DELTA_SIZE) == 0) {
+        return MEMORY_STATUS_OK;
+    }
+    if (app->committed < DELTA_COMMITS && memcmp(state, app->snapshots[app->committed + 1], DELTA_SIZE) == 0) {
+        return MEMORY_STATUS_OK;
+    }
+    return MEMORY_STATUS_NOK;
+}
+
+/*
+ * Log partition: a sequence of appends, after a restart the log must hold every acknowledged record and at
+ * most the one in flight, nothing else
+ */
+
+typedef struct {
+    uint8_t records[LOG_RECORDS][80];
+    uint16_t lengths[LOG_RECORDS];
+    uint32_t appended;
+} log_app_t;
+
+static log_app_t log_app;
+
+static const cat25256_partition_entry_t log_layout[] = {
+        {.id = LOG_ID, .policy = CAT25256_POLICY_LOG, .start = LOG_START, .size = LOG_SIZE},
+};
+
+static memory_status_t log_prepare(void *context, cat25256_handle_t *handle) {
+    log_app_t *app = context;
+    for (uint32_t i = 0; i < LOG_RECORDS; i++) {
+        app->lengths[i] = (uint16_t) (5 + (i * 23) % 70);
+        for (uint32_t b = 0; b < app->lengths[i]; b++) {
+            app->records[i][b] = (uint8_t) (i * 31 + b);
+        }
+    }
+
+    cat25256_partition_table_t table = {.handle = handle, .cs = 0, .table_address = 0x0000};
+    return cat25256_partition_format(&table, log_layout, 1);
+}
+
+static memory_status_t log_run(void *context, cat25256_handle_t *handle) {
+    log_app_t *app = context;
+    app->appended = 0;
+
+    cat25256_partition_table_t table = {.handle = handle, .cs = 0, .table_address = 0x0000};
+    memory_status_t rc = cat25256_partition_mount(&table);
+    for (uint32_t i = 0; rc == MEMORY_STATUS_OK && i < LOG_RECORDS; i++) {
+        rc = cat25256_partition_append(&table, LOG_ID, app->records[i], app->lengths[i], NULL);
+        if (rc == MEMORY_STATUS_OK) {
+            app->appended = i + 1;
+        }
+    }
+    return rc;
+}
+
+static memory_status_t log_recover(void *context, cat25256_handle_t *handle) {
+    log_app_t *app = context;
+    cat25256_partition_table_t table = {.handle = handle, .cs = 0, .table_address = 0x0000};
+    if (cat25256_partition_mount(&table) != MEMORY_STATUS_OK) {
+        return MEMORY_STATUS_NOK;
+    }
+
+    uint32_t head = table.partitions[0].log_head;
+    uint32_t offset = 0;
+    uint32_t count = 0;
+    while (offset < head) {
+        uint8_t record[LOG_HEADER_SIZE + 80];
+        if (count >= LOG_RECORDS ||
+            cat25256_partition_read(&table, LOG_ID, offset, record, LOG_HEADER_SIZE) != MEMORY_STATUS_OK) {
+            return MEMORY_STATUS_NOK;
+        }
+        uint16_t length = (uint16_t) (record[0] | record[1] << 8);
+        if (length != app->lengths[count] ||
+            cat25256_partition_read(&table, LOG_ID, offset + LOG_HEADER_SIZE, record, length) != MEMORY_STATUS_OK ||
+            memcmp(record, app->records[count], length) != 0) {
+            return MEMORY_STATUS_NOK;
+        }
+        offset += LOG_HEADER_SIZE + length;
+        count++;
+    }
+    return count == app->appended || count == app->appended + 1 ? MEMORY_STATUS_OK : MEMORY_STATUS_NOK;
+}
+
+static void print_result(void *context, const cat25256_cut_result_t *result) {
+    int csv = *(const int *) context;
+    unsigned long long point = result->cut.transactions;
+    if (result->cut.trigger == CAT25256_CUT_AT_TIME) {
+        point = result->cut.time_ns / 1000u;
+    } else if (result->cut.trigger == CAT25256_CUT_DURING_PROGRAM) {
+        point = result->cut.program;
+    }
+    const char *torn = result->torn ? torn_names[result->cut.torn] : "-";
+    if (csv) {
+        printf("%llu,%s,%s,%lu,%lu,%lu,%lu\n", point, torn, status_names[result->recovered],
+               (unsigned long) result->recovery_us, (unsigned long) result->recovery_transactions,
+               (unsigned long) result->recovery_programs, (unsigned long) result->recovery_bus_bytes);
+    } else if (result->recovered != MEMORY_STATUS_OK) {
+        printf("cut at %llu (page %s): recovery failed after %lu us\n", point, torn,
+               (unsigned long) result->recovery_us);
+    }
+}
+
+int main(int argc, char **argv) {
+    int csv = 0;
+    int first = 1;
+    sweep.seed = 1;
+    while (first < argc && strncmp(argv[first], "--", 2) == 0) {
+        if (strcmp(argv[first], "--csv") == 0) {
+            csv = 1;
+            first++;
+        } else if (strcmp(argv[first], "--time-step") == 0 && first + 1 < argc) {
+            sweep.trigger = CAT25256_CUT_AT_TIME;
+            sweep.time_step_us = (uint32_t) strtoul(argv[first + 1], NULL, 0);
+            first += 2;
+        } else if (strcmp(argv[first], "--programs") == 0) {
+            sweep.trigger = CAT25256_CUT_DURING_PROGRAM;
+            first++;
+        } else if (strcmp(argv[first], "--seed") == 0 && first + 1 < argc) {
+            sweep.seed = strtoull(argv[first + 1], NULL, 0);
+            first += 2;
+        } else {
+            break;
+        }
+    }
+
+    cat25256_powercut_app_t app;
+    if (sweep.trigger == CAT25256_CUT_AT_TIME && sweep.time_step_us == 0) {
+        first = argc;
+    }
+    if (first + 1 == argc && strcmp(argv[first], "delta") == 0) {
+        app = (cat25256_powercut_app_t) {&delta_app, delta_prepare, delta_run, delta_recover};
+    } else if (first + 1 == argc && strcmp(argv[first], "log") == 0) {
+        app = (cat25256_powercut_app_t) {&log_app, log_prepare, log_run, log_recover};
+    } else {
+        fprintf(stderr, "usage: %s [--csv] [--time-step <us> | --programs] [--seed <n>] delta|log\n", argv[0]);
+        return 2;
+    }
+
+    sweep.write_cycle_us = 3000;
+    sweep.report = print_result;
+    sweep.report_context = &csv;
+    if (csv) {
+        printf("%s,page,recovery,recovery_us,recovery_transactions,recovery_programs,recovery_bus_bytes\n",
+               sweep.trigger == CAT25256_CUT_AT_TIME ? "time_us" :
+               sweep.trigger == CAT25256_CUT_DURING_PROGRAM ? "program" : "transactions");
+    }
+    if (cat25256_powercut_sweep(&sweep, &app) != MEMORY_STATUS_OK) {
+        fprintf(stderr, "prepare or the uninterrupted run failed\n");
+        return 1;
+    }
+    if (!csv) {
+        printf("%s: %lu transactions, %lu programs, %.1f ms uninterrupted\n", argv[first],
+               (unsigned long) sweep.reference_transactions, (unsigned long) sweep.reference_programs,
+               sweep.reference_ns / 1e6);
+        printf("%lu cut points, %lu failed recoveries, recovery %.1f us mean, %lu us max\n",
+               (unsigned long) sweep.cuts, (unsigned long) sweep.failures,
+               sweep.cuts > 0 ? (double) sweep.total_recovery_us / sweep.cuts : 0.0,
+               (unsigned long) sweep.max_recovery_us);
+    }
+    return sweep.failures != 0;
+}
@@ -0,0 +1,125 @@
+/**
+ *  Copyright (C) 2021  Tobias Egger
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Runs workload scenarios against the simulated chip and prints their metrics, latencies are in virtual time.
+ *
+ * Usage: cat25256_workload [--csv] [--clock <hz>] [--twc <us>] <scenario.conf>...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cat25256_sim.h"
+#include "cat25256_workload.h"
+
+#define MAX_SAMPLES 65536
+
+static cat25256_sim_t sim;
+static cat25256_workload_t workload;
+static cat25256_sample_t samples[MAX_SAMPLES];
+
+static const char *const class_names[] = {"read", "write", "full_read"};
+
+static void print_result(const cat25256_scenario_t *scenario, const cat25256_workload_result_t *result,
+                         double energy_uj, int csv) {
+    if (csv) {
+        for (int c = 0; c < 3; c++) {
+            const cat25256_latency_t *latency = &result->latency[c];
+            printf("%s,%lu,%lu,%.1f,%lu,%lu,%lu,%.1f,%s,%lu,%lu,%lu,%lu,%lu\n", scenario->name,
+                   (unsigned long) result->operations, (unsigned long) result->errors, result->ops_per_s,
+                   (unsigned long) result->page_programs, (unsigned long) result->bus_bytes,
+                   (unsigned long) result->transactions, energy_uj, class_names[c], (unsigned long) latency->count,
+                   (unsigned long) latency->p50_us, (unsigned long) latency->p90_us, (unsigned long) latency->p99_us,
+                   (unsigned long) latency->max_us);
+        }
+        return;
+    }
+
+    printf("%s: %lu operations (%lu failed) in %.3f s, %.1f ops/s\n", scenario->name,
+           (unsigned long) result->operations, (unsigned long) result->errors, result->elapsed_us / 1e6,
+           result->ops_per_s);
+    printf("  %lu page programs, %lu bus bytes, %lu transactions\n", (unsigned long) result->page_programs,
+           (unsigned long) result->bus_bytes, (unsigned long) result->transactions);
+    printf("  %.3f mJ, %.3f uJ per operation\n", energy_uj / 1000.0,
+           result->operations > 0 ? energy_uj / result->operations : 0.0);
+    for (int c = 0; c < 3; c++) {
+        const cat25256_latency_t *latency = &result->latency[c];
+        if (latency->count == 0) {
+            continue;
+        }
+        printf("  %-9s %7lu ops  p50 %7lu us  p90 %7lu us  p99 %7lu us  max %7lu us\n", class_names[c],
+               (unsigned long) latency->count, (unsigned long) latency->p50_us, (unsigned long) latency->p90_us,
+               (unsigned long) latency->p99_us, (unsigned long) latency->max_us);
+    }
+}
+
+int main(int argc, char **argv) {
+    int csv = 0;
+    uint32_t clock_hz = 0;
+    uint32_t write_cycle_us = 3000;
+    int first = 1;
+    while (first < argc && strncmp(argv[first], "--", 2) == 0) {
+        if (strcmp(argv[first], "--csv") == 0) {
+            csv = 1;
+            first++;
+        } else if (strcmp(argv[first], "--clock") == 0 && first + 1 < argc) {
+            clock_hz = (uint32_t) strtoul(argv[first + 1], NULL, 0);
+            first += 2;
+        } else if (strcmp(argv[first], "--twc") == 0 && first + 1 < argc) {
+            write_cycle_us = (uint32_t) strtoul(argv[first + 1], NULL, 0);
+            first += 2;
+        } else {
+            break;
+        }
+    }
+    if (first >= argc) {
+        fprintf(stderr, "usage: %s [--csv] [--clock <hz>] [--twc <us>] <scenario.conf>...\n", argv[0]);
+        return 2;
+    }
+
+    if (csv) {
+        printf("scenario,operations,errors,ops_per_s,page_programs,bus_bytes,transactions,energy_uj,class,count,"
+               "p50_us,p90_us,p99_us,max_us\n");
+    }
+    workload.samples = samples;
+    workload.capacity = MAX_SAMPLES;
+
+    int status = 0;
+    for (int i = first; i < argc; i++) {
+        cat25256_scenario_t scenario;
+        if (cat25256_workload_load(argv[i], &scenario) != MEMORY_STATUS_OK) {
+            fprintf(stderr, "%s: cannot load scenario\n", argv[i]);
+            status = 1;
+            continue;
+        }
+
+        // Every scenario starts on an erased chip
+        cat25256_sim_init(&sim, clock_hz, write_cycle_us);
+        cat25256_handle_t handle = {0};
+        cat25256_sim_attach(&sim, &handle);
+
+        cat25256_workload_result_t result;
+        if (cat25256_workload_run(&workload, &handle, 0, &scenario, &result) != MEMORY_STATUS_OK) {
+            fprintf(stderr, "%s: invalid scenario\n", argv[i]);
+            status = 1;
+            continue;
+        }
+        // The chip's energy over the whole run, idle time between operations included
+        print_result(&scenario, &result, cat25256_sim_energy_pj(&sim) / 1e6, csv);
+    }
+    return status;
+}